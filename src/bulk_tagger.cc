@@ -0,0 +1,209 @@
+/* ner: src/bulk_tagger.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+
+#include "bulk_tagger.hh"
+#include "notmuch.hh"
+#include "tag_queue.hh"
+#include "status_bar.hh"
+
+/* The number of message IDs the worker hands over at once, which are tagged
+ * in one transaction */
+const std::size_t batchSize = 1000;
+
+/* The number of batches handed to the writer which haven't been applied yet */
+const std::size_t maxSubmitted = 4;
+
+/* How long to wait before trying a failed batch again */
+const std::chrono::seconds retryDelay(1);
+
+BulkTagger::BulkTagger()
+    : _collecting(false), _batches(16), _done(false), _total(0), _active(false),
+        _applied(0)
+{
+}
+
+BulkTagger::~BulkTagger()
+{
+    cancel();
+}
+
+void BulkTagger::start(const std::string & query, const std::vector<std::string> & addTags,
+    const std::vector<std::string> & removeTags)
+{
+    cancel();
+
+    _query = query;
+    _addTags = addTags;
+    _removeTags = removeTags;
+
+    _done = false;
+    _total = 0;
+    _applied = 0;
+    _active = true;
+    _collecting = true;
+
+    _thread = std::thread(std::bind(&BulkTagger::collectMessages, this,
+        Notmuch::readonlyDatabase()));
+}
+
+void BulkTagger::cancel()
+{
+    _collecting = false;
+
+    if (_thread.joinable())
+        _thread.join();
+
+    std::unique_ptr<Batch> batch;
+
+    while (_batches.pop(batch));
+
+    _submitted.clear();
+    _failed.clear();
+    _active = false;
+}
+
+bool BulkTagger::apply()
+{
+    if (!_active)
+        return true;
+
+    /* Count the batches the writer is done with */
+    while (!_submitted.empty() && _submitted.front().result.wait_for(
+        std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        Submission submission(std::move(_submitted.front()));
+        _submitted.pop_front();
+
+        try
+        {
+            submission.result.get();
+        }
+        catch (const InvalidMessageException & e)
+        {
+            /* The message was removed since the query was run */
+        }
+        catch (const std::runtime_error & e)
+        {
+            StatusBar::instance().displayMessage(std::string("Tagging failed, retrying: ") + e.what());
+
+            _failed.push_back(std::move(submission.batch));
+            _retryTime = std::chrono::steady_clock::now() + retryDelay;
+
+            continue;
+        }
+
+        _applied += submission.batch->size();
+    }
+
+    /* Read this before looking at the queue, so a batch pushed just before
+     * the worker finished isn't missed */
+    bool done = _done;
+    bool drained = false;
+
+    while (_submitted.size() < maxSubmitted)
+    {
+        std::unique_ptr<Batch> batch;
+
+        if (!_failed.empty())
+        {
+            if (std::chrono::steady_clock::now() < _retryTime)
+                break;
+
+            batch = std::move(_failed.front());
+            _failed.pop_front();
+        }
+        else if (!_batches.pop(batch))
+        {
+            drained = true;
+            break;
+        }
+
+        Notmuch::TagTransaction transaction;
+
+        for (auto id = batch->begin(), e = batch->end(); id != e; ++id)
+        {
+            for (auto tag = _addTags.begin(), e = _addTags.end(); tag != e; ++tag)
+                transaction.changeMessageTag(*id, *tag, true);
+
+            for (auto tag = _removeTags.begin(), e = _removeTags.end(); tag != e; ++tag)
+                transaction.changeMessageTag(*id, *tag, false);
+        }
+
+        Submission submission = { std::move(batch),
+            TagQueue::instance().commit(std::move(transaction)) };
+        _submitted.push_back(std::move(submission));
+    }
+
+    if (done && drained && _submitted.empty() && _failed.empty())
+    {
+        _thread.join();
+        _active = false;
+
+        return true;
+    }
+
+    return false;
+}
+
+void BulkTagger::collectMessages(notmuch_database_t * database)
+{
+    Notmuch::QueryPointer query(notmuch_query_create(database, _query.c_str()));
+
+    _total = notmuch_query_count_messages(query.get());
+
+    std::unique_ptr<Batch> batch(new Batch);
+    batch->reserve(batchSize);
+
+    notmuch_messages_t * messages;
+    for (messages = notmuch_query_search_messages(query.get());
+        _collecting && notmuch_messages_valid(messages);
+        notmuch_messages_move_to_next(messages))
+    {
+        notmuch_message_t * message = notmuch_messages_get(messages);
+        batch->push_back(notmuch_message_get_message_id(message));
+        notmuch_message_destroy(message);
+
+        if (batch->size() == batchSize)
+        {
+            while (_collecting && !_batches.push(batch))
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+            batch.reset(new Batch);
+            batch->reserve(batchSize);
+        }
+    }
+
+    if (!batch->empty())
+    {
+        while (_collecting && !_batches.push(batch))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    query.reset();
+    Notmuch::releaseDatabase(database);
+
+    _done = true;
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
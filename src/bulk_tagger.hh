@@ -0,0 +1,119 @@
+/* ner: src/bulk_tagger.hh
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NER_BULK_TAGGER_H
+#define NER_BULK_TAGGER_H 1
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <chrono>
+
+#include "spsc_queue.hh"
+
+#include <notmuch.h>
+
+/**
+ * Changes the tags of every message matching a query, without holding up the
+ * user interface.
+ *
+ * A worker thread streams the IDs of the matching messages from a read-only
+ * database. apply() hands each batch of them to the writer of the TagQueue,
+ * as one atomic transaction.
+ */
+class BulkTagger
+{
+    public:
+        BulkTagger();
+        BulkTagger(const BulkTagger &) = delete;
+        BulkTagger & operator=(const BulkTagger &) = delete;
+        ~BulkTagger();
+
+        /**
+         * Starts tagging the messages matching query, cancelling whatever
+         * was being tagged before.
+         */
+        void start(const std::string & query, const std::vector<std::string> & addTags,
+            const std::vector<std::string> & removeTags);
+
+        /**
+         * Stops tagging. The batches which were already handed to the writer
+         * are still applied.
+         */
+        void cancel();
+
+        /**
+         * Counts the batches the writer has applied, and hands it those
+         * which have arrived since. If a batch fails, it is handed over
+         * again after a delay.
+         *
+         * \return Whether every matching message has now been tagged.
+         */
+        bool apply();
+
+        bool active() const { return _active; }
+
+        unsigned applied() const { return _applied; }
+        unsigned total() const { return _total; }
+
+    private:
+        typedef std::vector<std::string> Batch;
+
+        /**
+         * Runs in the worker thread, and releases database when done.
+         */
+        void collectMessages(notmuch_database_t * database);
+
+        std::string _query;
+        std::vector<std::string> _addTags;
+        std::vector<std::string> _removeTags;
+
+        std::thread _thread;
+        std::atomic<bool> _collecting;
+
+        SpscQueue<std::unique_ptr<Batch>> _batches;
+
+        struct Submission
+        {
+            std::unique_ptr<Batch> batch;
+            std::future<void> result;
+        };
+
+        /* The batches with the writer, in the order they were handed over */
+        std::deque<Submission> _submitted;
+
+        /* The batches which failed, and when to try them again */
+        std::deque<std::unique_ptr<Batch>> _failed;
+        std::chrono::steady_clock::time_point _retryTime;
+
+        /* Set once the last batch is in the queue */
+        std::atomic<bool> _done;
+        std::atomic<unsigned> _total;
+
+        bool _active;
+        unsigned _applied;
+};
+
+#endif
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
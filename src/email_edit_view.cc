@@ -85,7 +85,8 @@ void EmailEditView::edit()
     PartList partsBackup;
     partsBackup.swap(_parts); // parts will be cleared anyway
 
-    setEmail(_messageFile);
+    /* The draft is rewritten by each edit, and removed once it is sent */
+    setEmail(_messageFile, false);
 
     std::copy_if(partsBackup.begin(), partsBackup.end(),
                  std::back_inserter(_parts),
@@ -227,7 +228,10 @@ void EmailEditView::removeSelectedAttachment()
 {
     PartList::iterator selection = selectedPart();
     if (dynamic_cast<Attachment*>(selection->get()))
+    {
+        _unfoldedParts.erase(selection->get());
         _parts.erase(selection);
+    }
 }
 
 void EmailEditView::setIdentity(const std::string & name)
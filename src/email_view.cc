@@ -22,6 +22,7 @@
 #include "colors.hh"
 #include "ncurses.hh"
 #include "util.hh"
+#include "message_cache.hh"
 #include "status_bar.hh"
 #include "message_part_display_visitor.hh"
 #include "message_part_save_visitor.hh"
@@ -45,38 +46,21 @@ EmailView::~EmailView()
 {
 }
 
-void EmailView::setEmail(const std::string & filename)
+void EmailView::setEmail(const std::string & filename, bool cache)
 {
     _parts.clear();
+    _unfoldedParts.clear();
 
-    FILE * file = fopen(filename.c_str(), "r");
+    auto message = cache ? MessageCache::instance().get(filename) :
+        MessageCache::parse(filename, false);
 
-    if (file != NULL)
+    if (message)
     {
-        GMimeStream * stream = g_mime_stream_file_new(file);
-        GMimeParser * parser = g_mime_parser_new_with_stream(stream);
-        GMimeMessage * message = g_mime_parser_construct_message(parser);
-
-        /* Read relavant headers */
-        _headers = {
-            { "To",         internet_address_list_to_string(g_mime_message_get_recipients(message,
-                GMIME_RECIPIENT_TYPE_TO), true) ? : "(null)" },
-            { "From",       g_mime_message_get_sender(message) ? : "(null)" },
-            { "Cc",         internet_address_list_to_string(g_mime_message_get_recipients(message,
-                GMIME_RECIPIENT_TYPE_CC), true) ? : "(null)" },
-            { "Bcc",         internet_address_list_to_string(g_mime_message_get_recipients(message,
-                GMIME_RECIPIENT_TYPE_BCC), true) ? : "(null)" },
-            { "Subject",    g_mime_message_get_subject(message) ? : "(null)" }
-        };
-
-        GMimeObject * mimePart = g_mime_message_get_mime_part(message);
-
-        /* Locate plain text parts */
-        processMimePart(mimePart, std::back_inserter(_parts));
-        if (not _parts.empty())
-            _parts[0]->folded = false;
+        _headers = message->headers;
+        _parts = message->parts;
 
-        g_object_unref(mimePart);
+        if (not _parts.empty())
+            _unfoldedParts.insert(_parts[0].get());
     }
 }
 
@@ -120,7 +104,8 @@ void EmailView::update()
     ++row;
 
     MessagePartDisplayVisitor displayVisitor(_window, View::Geometry{ 0, row,
-        _geometry.width, visibleLines() }, _offset, _selectedIndex, _parts.size() > 1);
+        _geometry.width, visibleLines() }, _offset, _selectedIndex, _parts.size() > 1,
+        _unfoldedParts);
 
 
     for (auto part = _parts.begin(), e = _parts.end(); part != e; ++part)
@@ -146,6 +131,19 @@ void EmailView::update()
     wattroff(_window, COLOR_PAIR(ColorID::MoreLessIndicator));
 }
 
+bool EmailView::busy() const
+{
+    for (auto part = _parts.begin(), e = _parts.end(); part != e; ++part)
+    {
+        TextPart * textPart = dynamic_cast<TextPart *>(part->get());
+
+        if (textPart && _unfoldedParts.count(textPart) && textPart->pending())
+            return true;
+    }
+
+    return false;
+}
+
 EmailView::PartList::iterator EmailView::selectedPart()
 {
     for (size_t index = 0; index < _partsEndLine.size(); ++index)
@@ -168,7 +166,8 @@ void EmailView::toggleSelectedPartFolding()
     if (_parts.size() == 1)
         return;
 
-    (*part)->folded = not (*part)->folded;
+    if (!_unfoldedParts.erase(part->get()))
+        _unfoldedParts.insert(part->get());
 
     if (part != _parts.begin())
         _selectedIndex = _partsEndLine[std::distance(_parts.begin(), part) - 1];
@@ -181,6 +180,22 @@ void EmailView::toggleSelectedPartFolding()
     StatusBar::instance().refresh();
 }
 
+void EmailView::moveToBottom()
+{
+    for (auto part = _parts.begin(), e = _parts.end(); part != e; ++part)
+    {
+        TextPart * textPart = dynamic_cast<TextPart *>(part->get());
+
+        if (textPart && _unfoldedParts.count(textPart))
+            textPart->decode();
+    }
+
+    /* Recount the lines now that all of them are decoded */
+    update();
+
+    LineBrowserView::moveToBottom();
+}
+
 int EmailView::visibleLines() const
 {
     return getmaxy(_window) - _visibleHeaders.size() - 1;
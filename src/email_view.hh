@@ -22,6 +22,7 @@
 
 #include <vector>
 #include <map>
+#include <set>
 #include <gmime/gmime.h>
 
 #include "line_browser_view.hh"
@@ -35,13 +36,30 @@ class EmailView : public LineBrowserView
         EmailView(const View::Geometry & geometry = View::Geometry());
         virtual ~EmailView();
 
-        void setEmail(const std::string & emailFilePath);
+        /**
+         * Shows the message in emailFilePath.
+         *
+         * \param cache Whether the message is shared through the MessageCache.
+         *     Files which are rewritten or removed while they are shown, such
+         *     as drafts, are read into memory and kept out of the cache.
+         */
+        void setEmail(const std::string & emailFilePath, bool cache = true);
         void setVisibleHeaders(const std::vector<std::string> & headers);
 
         virtual void update();
+
+        /**
+         * Whether an unfolded part is waiting for its HTML to be rendered.
+         */
+        virtual bool busy() const;
         void saveSelectedPart();
         void toggleSelectedPartFolding();
 
+        /**
+         * Decodes the rest of the unfolded parts, so the last line is known.
+         */
+        virtual void moveToBottom();
+
     protected:
         void calculateLines();
         virtual int visibleLines() const;
@@ -56,6 +74,10 @@ class EmailView : public LineBrowserView
 
         PartList _parts;
         std::vector<int> _partsEndLine;
+
+        /* The parts are shared with other views through the MessageCache, so
+         * their folding is kept here rather than in the parts */
+        std::set<const MessagePart *> _unfoldedParts;
 };
 
 #endif
@@ -0,0 +1,232 @@
+/* ner: src/handoff_benchmark.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measures how fast the search view's collector can hand threads over to the
+ * UI thread, once with the UI idle, and once while it scrolls, and how much
+ * memory the received threads take.
+ *
+ * The threads matching a search are loaded from a notmuch database first, and
+ * then replayed through the handoff, so the numbers don't include the time
+ * notmuch takes to find them.
+ *
+ * Build it with `make handoff_benchmark` in src, and run it as
+ *
+ *     handoff_benchmark <database path> [search terms] [repetitions]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <cstdlib>
+#include <time.h>
+
+#include "thread_store.hh"
+#include "spsc_queue.hh"
+
+#include <notmuch.h>
+
+/* The same as the search view's */
+const int maxBatchSize = 256;
+const std::chrono::milliseconds maxBatchDelay(50);
+const std::size_t batchQueueSize = 64;
+
+/* The UI updates this often while idle, as with ner's busy timeout */
+const std::chrono::milliseconds idleInterval(100);
+
+/* The UI redraws this often while scrolling, as with a held down key */
+const std::chrono::milliseconds keyRepeatInterval(33);
+
+/* The rows drawn on each redraw */
+const int screenRows = 50;
+
+typedef SpscQueue<std::unique_ptr<ThreadStore>> BatchQueue;
+
+/**
+ * Hands the threads in source over in batches, repetitions times, the same way
+ * as SearchView::collectThreads.
+ */
+void collect(const ThreadStore & source, BatchQueue & batches, int repetitions)
+{
+    std::unique_ptr<ThreadStore> batch(new ThreadStore);
+    auto batchStart = std::chrono::steady_clock::now();
+
+    for (int repetition = 0; repetition < repetitions; ++repetition)
+    {
+        for (int index = source.first(); index < source.end(); ++index)
+        {
+            batch->append(source, index);
+
+            auto now = std::chrono::steady_clock::now();
+
+            if ((batch->end() >= maxBatchSize || now - batchStart >= maxBatchDelay)
+                && batches.push(batch))
+            {
+                batch.reset(new ThreadStore);
+                batchStart = now;
+            }
+        }
+    }
+
+    while (!batch->empty() && !batches.push(batch))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+/**
+ * Formats a row of the search view, and returns its length.
+ */
+std::size_t drawRow(const ThreadStore & threads, int index)
+{
+    time_t date = threads.newestDate(index);
+    struct tm dateParts;
+    char formattedDate[32];
+
+    localtime_r(&date, &dateParts);
+    strftime(formattedDate, sizeof(formattedDate), "%x", &dateParts);
+
+    std::string row(formattedDate);
+    row += std::to_string(threads.matchedMessages(index)) + '/' +
+        std::to_string(threads.totalMessages(index));
+    row += threads.authors(index);
+    row += threads.subject(index);
+    row += TagDictionary::instance().join(threads.tags(index));
+
+    return row.size();
+}
+
+/**
+ * Receives all of the threads from a collector into threads, and returns the
+ * rate they arrived at, in threads per second.
+ */
+double receive(const ThreadStore & source, int repetitions, bool scrolling,
+    ThreadStore & threads)
+{
+    BatchQueue batches(batchQueueSize);
+    int expected = (source.end() - source.first()) * repetitions;
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread collector(collect, std::cref(source), std::ref(batches), repetitions);
+
+    std::unique_ptr<ThreadStore> batch;
+    int offset = 0;
+    std::size_t drawn = 0;
+
+    while (threads.end() < expected)
+    {
+        /* As in SearchView::receiveThreads */
+        while (batches.pop(batch))
+        {
+            for (int index = 0; index < batch->end(); ++index)
+                threads.append(*batch, index);
+        }
+
+        if (scrolling)
+        {
+            for (int row = 0; row < screenRows && offset + row < threads.end(); ++row)
+                drawn += drawRow(threads, offset + row);
+
+            if (offset + screenRows < threads.end())
+                ++offset;
+
+            std::this_thread::sleep_for(keyRepeatInterval);
+        }
+        else
+            std::this_thread::sleep_for(idleInterval);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    collector.join();
+
+    /* Keep the drawing from being optimized away */
+    if (drawn == 0 && scrolling && expected > 0)
+        std::cerr << "Nothing was drawn" << std::endl;
+
+    return expected / elapsed.count();
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0]
+            << " <database path> [search terms] [repetitions]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string terms(argc > 2 ? argv[2] : "*");
+    int repetitions = argc > 3 ? std::atoi(argv[3]) : 10;
+
+    notmuch_database_t * database;
+
+    if (notmuch_database_open(argv[1], NOTMUCH_DATABASE_MODE_READ_ONLY,
+        &database) != NOTMUCH_STATUS_SUCCESS)
+    {
+        std::cerr << "Couldn't open the database at " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ThreadStore source;
+
+    notmuch_query_t * query = notmuch_query_create(database, terms.c_str());
+    notmuch_threads_t * threads;
+
+    for (threads = notmuch_query_search_threads(query);
+        notmuch_threads_valid(threads);
+        notmuch_threads_move_to_next(threads))
+    {
+        notmuch_thread_t * thread = notmuch_threads_get(threads);
+        source.append(thread);
+        notmuch_thread_destroy(thread);
+    }
+
+    notmuch_query_destroy(query);
+    notmuch_database_close(database);
+
+    if (source.empty() || repetitions < 1)
+    {
+        std::cerr << "No threads to hand over" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Handing over " << source.end() << " threads, "
+        << repetitions << " times" << std::endl;
+
+    std::cout << std::fixed << std::setprecision(0);
+
+    {
+        ThreadStore received;
+        std::cout << "idle:      " << receive(source, repetitions, false, received)
+            << " threads/s" << std::endl;
+    }
+
+    ThreadStore received;
+    std::cout << "scrolling: " << receive(source, repetitions, true, received)
+        << " threads/s" << std::endl;
+
+    std::cout << "memory:    " << double(received.memoryUsage()) / received.end()
+        << " bytes/thread" << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
@@ -0,0 +1,300 @@
+/* ner: src/html_renderer.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <cerrno>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "html_renderer.hh"
+#include "ner_config.hh"
+
+/* How long the html command may take on one document */
+const std::chrono::seconds renderTimeout(10);
+
+/* The number of renderings kept for reuse */
+const std::size_t cachedRenderings = 64;
+
+HtmlRendering::HtmlRendering()
+    : _done(false)
+{
+}
+
+bool HtmlRendering::done() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _done;
+}
+
+void HtmlRendering::wait() const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _finished.wait(lock, [this] { return _done; });
+}
+
+void HtmlRendering::finish(std::string & text)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _text.swap(text);
+        _done = true;
+    }
+
+    _finished.notify_all();
+}
+
+HtmlRenderer & HtmlRenderer::instance()
+{
+    static HtmlRenderer * renderer = NULL;
+    static std::once_flag created;
+
+    /* Parts are made by the prefetching threads as well */
+    std::call_once(created, [] { renderer = new HtmlRenderer(); });
+
+    return *renderer;
+}
+
+HtmlRenderer::HtmlRenderer()
+{
+    /* The renderer lives until ner exits */
+    std::thread(std::bind(&HtmlRenderer::run, this)).detach();
+}
+
+std::shared_ptr<const HtmlRendering> HtmlRenderer::render(const std::string & html)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto cached = _cache.find(html);
+
+    if (cached != _cache.end())
+        return cached->second;
+
+    std::shared_ptr<HtmlRendering> rendering(new HtmlRendering);
+
+    _cache[html] = rendering;
+    _cacheOrder.push_back(html);
+
+    /* The parts showing an evicted rendering keep it until they are done */
+    while (_cacheOrder.size() > cachedRenderings)
+    {
+        _cache.erase(_cacheOrder.front());
+        _cacheOrder.pop_front();
+    }
+
+    _jobs.push_back(Job{ html, rendering });
+    _wakeup.notify_one();
+
+    return rendering;
+}
+
+void HtmlRenderer::run()
+{
+    /* Have writes to a command which has exited fail with EPIPE, rather than
+     * raising SIGPIPE */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &signals, &_originalSignals);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        _wakeup.wait(lock, [this] { return !_jobs.empty(); });
+
+        Job job(std::move(_jobs.front()));
+        _jobs.pop_front();
+
+        lock.unlock();
+
+        std::string text;
+        bool finished = convert(job.html, text);
+
+        lock.lock();
+
+        /* Run the command again next time, rather than keep a partial
+         * rendering */
+        if (!finished)
+        {
+            auto cached = _cache.find(job.html);
+
+            if (cached != _cache.end() && cached->second == job.rendering)
+                _cache.erase(cached);
+        }
+
+        job.rendering->finish(text);
+    }
+}
+
+bool HtmlRenderer::convert(const std::string & html, std::string & text)
+{
+    std::string command(NerConfig::instance().command("html"));
+
+    int input[2];
+    int output[2];
+
+    if (pipe2(input, O_CLOEXEC) != 0)
+    {
+        text = "[cannot run the html command]";
+        return false;
+    }
+
+    if (pipe2(output, O_CLOEXEC) != 0)
+    {
+        close(input[0]);
+        close(input[1]);
+        text = "[cannot run the html command]";
+        return false;
+    }
+
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        dup2(input[0], 0);
+        dup2(output[1], 1);
+
+        /* The command would otherwise inherit the blocked SIGPIPE */
+        pthread_sigmask(SIG_SETMASK, &_originalSignals, NULL);
+
+        execlp("sh", "sh", "-c", command.c_str(), NULL);
+        _exit(127);
+    }
+
+    close(input[0]);
+    close(output[1]);
+
+    if (pid == -1)
+    {
+        close(input[1]);
+        close(output[0]);
+        text = "[cannot run the html command]";
+        return false;
+    }
+
+    int in = input[1];
+    int out = output[0];
+
+    fcntl(in, F_SETFL, O_NONBLOCK);
+    fcntl(out, F_SETFL, O_NONBLOCK);
+
+    auto deadline = std::chrono::steady_clock::now() + renderTimeout;
+    std::size_t written = 0;
+    bool timedOut = false;
+    char buffer[4096];
+
+    if (html.empty())
+    {
+        close(in);
+        in = -1;
+    }
+
+    /* Keep writing the document and reading the text as the command allows,
+     * so neither side can fill up its pipe while waiting for the other */
+    while (out != -1)
+    {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+
+        if (remaining <= 0)
+        {
+            timedOut = true;
+            break;
+        }
+
+        struct pollfd descriptors[2] = {
+            { out, POLLIN, 0 },
+            { in, POLLOUT, 0 }
+        };
+
+        bool writing = in != -1;
+
+        if (poll(descriptors, writing ? 2 : 1, remaining) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            timedOut = true;
+            break;
+        }
+
+        if (writing && descriptors[1].revents)
+        {
+            ssize_t count = write(in, html.data() + written, html.size() - written);
+
+            if (count > 0)
+                written += count;
+
+            if ((count == -1 && errno != EAGAIN && errno != EINTR) || written == html.size())
+            {
+                close(in);
+                in = -1;
+            }
+        }
+
+        if (descriptors[0].revents)
+        {
+            ssize_t count = read(out, buffer, sizeof(buffer));
+
+            if (count > 0)
+                text.append(buffer, count);
+            else if (count == 0 || (errno != EAGAIN && errno != EINTR))
+            {
+                close(out);
+                out = -1;
+            }
+        }
+    }
+
+    if (in != -1)
+        close(in);
+
+    if (out != -1)
+        close(out);
+
+    /* The command may still be running after closing its output */
+    while (!timedOut && waitpid(pid, NULL, WNOHANG) == 0)
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+            timedOut = true;
+        else
+            usleep(10000);
+    }
+
+    if (timedOut)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+
+        text.append("\n[the html command timed out]");
+    }
+
+    return !timedOut;
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
@@ -0,0 +1,123 @@
+/* ner: src/html_renderer.hh
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NER_HTML_RENDERER_H
+#define NER_HTML_RENDERER_H 1
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <signal.h>
+
+/**
+ * The text of an HTML document, which arrives once the html command is done
+ * with it.
+ */
+class HtmlRendering
+{
+    public:
+        HtmlRendering();
+
+        bool done() const;
+
+        /**
+         * Waits until the text has arrived.
+         */
+        void wait() const;
+
+        /**
+         * The text. Only call this once done() returns true.
+         */
+        const std::string & text() const { return _text; }
+
+    private:
+        friend class HtmlRenderer;
+
+        void finish(std::string & text);
+
+        mutable std::mutex _mutex;
+        mutable std::condition_variable _finished;
+
+        bool _done;
+        std::string _text;
+};
+
+/**
+ * Converts HTML to text with the html command, without holding up the user
+ * interface.
+ *
+ * A worker thread runs the command for one document at a time, streaming the
+ * document in and the text out through non-blocking pipes, and kills it if it
+ * takes too long. The text is kept for the most recently rendered documents,
+ * looked up by their content, so rendering a document again does not run the
+ * command.
+ */
+class HtmlRenderer
+{
+    public:
+        static HtmlRenderer & instance();
+
+        /**
+         * Starts rendering html, unless it has been rendered already. This
+         * can be called from any thread.
+         */
+        std::shared_ptr<const HtmlRendering> render(const std::string & html);
+
+    private:
+        HtmlRenderer();
+
+        /**
+         * Runs in the worker thread, forever.
+         */
+        void run();
+
+        /**
+         * Runs the html command on html, appending its output to text.
+         *
+         * \return Whether the command finished in time.
+         */
+        bool convert(const std::string & html, std::string & text);
+
+        /* The signal mask of the worker thread before it blocked SIGPIPE,
+         * which the command is run with */
+        sigset_t _originalSignals;
+
+        /* Guards everything below */
+        std::mutex _mutex;
+        std::condition_variable _wakeup;
+
+        struct Job
+        {
+            std::string html;
+            std::shared_ptr<HtmlRendering> rendering;
+        };
+
+        std::deque<Job> _jobs;
+
+        /* The renderings by their document, oldest first in _cacheOrder */
+        std::unordered_map<std::string, std::shared_ptr<HtmlRendering>> _cache;
+        std::deque<std::string> _cacheOrder;
+};
+
+#endif
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
@@ -0,0 +1,208 @@
+/* ner: src/leak_soak.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Opens and closes the threads and messages of a search over and over, the way
+ * the thread and message views do, and reports the resident memory as it goes.
+ * Once the caches have filled up, it should stay flat.
+ *
+ * Build it with `make leak_soak` in src, and run it as
+ *
+ *     leak_soak [search terms] [cycles]
+ *
+ * It uses the same notmuch and ner configuration as ner.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+#include "notmuch.hh"
+#include "ner_config.hh"
+#include "message.hh"
+#include "message_tree.hh"
+#include "message_cache.hh"
+#include "message_part.hh"
+#include "message_part_visitor.hh"
+
+const std::string notmuchConfigFile(".notmuch-config");
+
+/* The number of threads of the search which are opened in turn */
+const std::size_t sampleSize = 50;
+
+/* The number of cycles between reports */
+const int reportInterval = 500;
+
+/**
+ * Decodes every text part, as displaying them would.
+ */
+class PartDecoder : public MessagePartVisitor
+{
+    public:
+        virtual void visit(const TextPart & part)
+        {
+            part.wait();
+            part.decode();
+        }
+
+        virtual void visit(const Attachment & part)
+        {
+        }
+};
+
+/**
+ * The resident set size of this process, in kilobytes.
+ */
+long residentSize()
+{
+    long size = 0, resident = 0;
+    FILE * statm = std::fopen("/proc/self/statm", "r");
+
+    if (statm)
+    {
+        if (std::fscanf(statm, "%ld %ld", &size, &resident) != 2)
+            resident = 0;
+
+        std::fclose(statm);
+    }
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Opens the thread with the given ID, and each of its messages.
+ */
+void openThread(const std::string & threadId)
+{
+    notmuch_database_t * database = Notmuch::readonlyDatabase();
+
+    /* The tree takes over the database */
+    MessageTree tree;
+    tree.load(database, threadId, NerConfig::instance().threadFoldDepth(),
+        NerConfig::instance().threadFoldSize());
+
+    Notmuch::getThread(threadId, database);
+
+    PartDecoder decoder;
+
+    for (int index = 0; index < tree.size(); ++index)
+    {
+        tree.sender(index);
+
+        MessageHandle message(tree.id(index));
+        message.date();
+        message.header("Subject");
+        message.tags();
+
+        auto parsed = MessageCache::parse(message.filename(), false);
+
+        if (parsed)
+        {
+            for (auto part = parsed->parts.begin(), e = parsed->parts.end(); part != e; ++part)
+                (*part)->accept(decoder);
+        }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    g_mime_init(0);
+
+    const char * environmentConfigPath = std::getenv("NOTMUCH_CONFIG");
+    std::string configPath(environmentConfigPath ? environmentConfigPath :
+        std::string(std::getenv("HOME")) + "/" + notmuchConfigFile);
+
+    std::string terms(argc > 1 ? argv[1] : "*");
+    int cycles = argc > 2 ? std::atoi(argv[2]) : 5000;
+
+    std::vector<std::string> threadIds;
+
+    try
+    {
+        Notmuch::initializeDatabase(configPath);
+        NerConfig::instance().load();
+
+        notmuch_database_t * database = Notmuch::readonlyDatabase();
+        Notmuch::QueryPointer query(notmuch_query_create(database, terms.c_str()));
+        notmuch_threads_t * threads;
+
+        for (threads = notmuch_query_search_threads(query.get());
+            notmuch_threads_valid(threads) && threadIds.size() < sampleSize;
+            notmuch_threads_move_to_next(threads))
+        {
+            notmuch_thread_t * thread = notmuch_threads_get(threads);
+            threadIds.push_back(notmuch_thread_get_thread_id(thread));
+            notmuch_thread_destroy(thread);
+        }
+
+        query.reset();
+        Notmuch::releaseDatabase(database);
+    }
+    catch (const std::exception & e)
+    {
+        std::cerr << "Couldn't open the database: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (const std::string * message)
+    {
+        std::cerr << *message << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (threadIds.empty())
+    {
+        std::cerr << "No threads match " << terms << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    long firstReport = 0;
+
+    for (int cycle = 1; cycle <= cycles; ++cycle)
+    {
+        try
+        {
+            openThread(threadIds[cycle % threadIds.size()]);
+        }
+        catch (const std::exception & e)
+        {
+            std::cerr << "Cycle " << cycle << " failed: " << e.what() << std::endl;
+        }
+
+        if (cycle % reportInterval == 0 || cycle == cycles)
+        {
+            long resident = residentSize();
+
+            if (!firstReport)
+                firstReport = resident;
+
+            std::cout << cycle << " cycles: " << resident << " kB resident" << std::endl;
+        }
+    }
+
+    std::cout << "Growth since the first report: "
+        << residentSize() - firstReport << " kB" << std::endl;
+
+    Notmuch::closeDatabase();
+
+    return EXIT_SUCCESS;
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
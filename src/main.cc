@@ -31,8 +31,10 @@
 #include "search_list_view.hh"
 #include "identity_manager.hh"
 #include "ner_config.hh"
+#include "tag_queue.hh"
 
 const std::string notmuchConfigFile(".notmuch-config");
+const std::string tagJournalFile(".ner-journal");
 
 void resize(int arg)
 {
@@ -106,9 +108,8 @@ int main(int argc, char * argv[])
         Notmuch::initializeDatabase(configPath);
         NerConfig::instance().load();
 
-        if (NerConfig::instance().refreshView())
-            /* Refresh the view every minute (or when the user presses a key). */
-            timeout(60000);
+        /* The writer starts on the tag changes the last session didn't get to */
+        TagQueue::instance().openJournal(std::string(std::getenv("HOME")) + "/" + tagJournalFile);
 
         Ner ner;
 
@@ -116,6 +117,9 @@ int main(int argc, char * argv[])
         ner.viewManager().addView(searchListView);
 
         ner.run();
+
+        /* Whatever can't be written now stays in the journal */
+        TagQueue::instance().flush();
     }
     catch (const std::exception & e)
     {
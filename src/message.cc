@@ -1,5 +1,6 @@
 #include "message.hh"
 #include "notmuch.hh"
+#include "tag_queue.hh"
 
 InvalidMessageException::InvalidMessageException(const std::string & messageId)
     : _id(messageId)
@@ -15,74 +16,78 @@ const char * InvalidMessageException::what() const throw()
     return ("Cannot find message with ID: " + _id).c_str();
 }
 
-Message::Message(notmuch_message_t * message)
+MessageHandle::MessageHandle(const std::string & id)
+    : _id(id), _database(NULL), _message(NULL)
 {
-    id       = notmuch_message_get_message_id(message);
-    filename = notmuch_message_get_filename(message);
-    date     = notmuch_message_get_date(message);
-
-
-    headers = {
-        { "From",    notmuch_message_get_header(message, "From")    ? : "(null)" },
-        { "To",      notmuch_message_get_header(message, "To")      ? : "(null)" },
-        { "Subject", notmuch_message_get_header(message, "Subject") ? : "(null)" },
-    };
-
+}
 
-    notmuch_tags_t * tagIterator;
-    for (tagIterator = notmuch_message_get_tags(message);
-        notmuch_tags_valid(tagIterator);
-        notmuch_tags_move_to_next(tagIterator))
-    {
-        tags.insert(notmuch_tags_get(tagIterator));
-    }
-    notmuch_tags_destroy(tagIterator);
+MessageHandle::MessageHandle(MessageHandle && other)
+    : _id(std::move(other._id)), _database(other._database), _message(other._message)
+{
+    other._database = NULL;
+    other._message = NULL;
+}
 
+MessageHandle::~MessageHandle()
+{
+    if (_message)
+        notmuch_message_destroy(_message);
 
-    notmuch_messages_t * messages;
-    for (messages = notmuch_message_get_replies(message);
-        notmuch_messages_valid(messages);
-        notmuch_messages_move_to_next(messages))
-    {
-        replies.push_back(Message(notmuch_messages_get(messages)));
-    }
-    notmuch_messages_destroy(messages);
+    if (_database)
+        Notmuch::releaseDatabase(_database);
 }
 
-void Message::removeTag(std::string tag)
+std::string MessageHandle::filename() const
 {
-    auto message = Notmuch::message(id);
+    return notmuch_message_get_filename(message());
+}
 
-    notmuch_message_remove_tag(message, tag.c_str());
-    tags.erase(tag);
+time_t MessageHandle::date() const
+{
+    return notmuch_message_get_date(message());
+}
 
-    notmuch_message_destroy(message);
+std::string MessageHandle::header(const std::string & name) const
+{
+    return notmuch_message_get_header(message(), name.c_str()) ? : "";
 }
 
-void Message::removeTagRecursive(std::string tag)
+TagSet MessageHandle::tags() const
 {
-    removeTag(tag);
+    TagSet tags;
+    TagDictionary & dictionary = TagDictionary::instance();
 
-    for (Message m : replies) {
-        m.removeTagRecursive(tag);
+    notmuch_tags_t * tagIterator;
+    for (tagIterator = notmuch_message_get_tags(message());
+        notmuch_tags_valid(tagIterator);
+        notmuch_tags_move_to_next(tagIterator))
+    {
+        tags.insert(dictionary.intern(notmuch_tags_get(tagIterator)));
     }
+    notmuch_tags_destroy(tagIterator);
+
+    return tags;
 }
 
-void Message::addTag(std::string tag)
+void MessageHandle::addTag(const std::string & tag, const void * origin)
 {
-    auto message = Notmuch::message(id);
-
-    notmuch_message_add_tag(message, tag.c_str());
-    tags.insert(tag);
+    TagQueue::instance().changeMessageTag(_id, tag, true, origin);
+}
 
-    notmuch_message_destroy(message);
+void MessageHandle::removeTag(const std::string & tag, const void * origin)
+{
+    TagQueue::instance().changeMessageTag(_id, tag, false, origin);
 }
 
-void Message::addTagRecursive(std::string tag)
+notmuch_message_t * MessageHandle::message() const
 {
-    addTag(tag);
+    if (!_message)
+    {
+        if (!_database)
+            _database = Notmuch::readonlyDatabase();
 
-    for (Message m : replies) {
-        m.addTagRecursive(tag);
+        _message = Notmuch::message(_id, _database).release();
     }
+
+    return _message;
 }
@@ -2,9 +2,8 @@
 #define NER_MESSAGE_H 1
 
 #include <string>
-#include <vector>
-#include <map>
-#include <set>
+
+#include "tag_set.hh"
 
 #include "notmuch.h"
 
@@ -21,87 +20,52 @@ class InvalidMessageException : public std::exception
         std::string _id;
 };
 
-template <class T>
-    class MessageTreeIterator
+/**
+ * A message looked up by ID, which only reads the fields that are asked for.
+ *
+ * The message is looked up the first time a field is read, on a read-only
+ * database which stays checked out for as long as the handle lives. Tag
+ * changes only need the ID, so they don't look it up at all.
+ */
+class MessageHandle
 {
     public:
-        template <class InputIterator>
-            explicit MessageTreeIterator(InputIterator begin, InputIterator end)
-        {
-            for (; begin < end; ++begin)
-                messages.push_back(&*begin);
-        }
-
-        MessageTreeIterator()
-        {
-        }
-
-        typedef T value_type;
-        typedef T & reference;
-        typedef T * pointer;
-        typedef std::ptrdiff_t difference_type;
-        typedef std::input_iterator_tag iterator_category;
-
-        reference operator*() const
-        {
-            return *messages.back();
-        }
-
-        pointer operator->() const
-        {
-            return messages.back();
-        }
-
-        reference operator++()
-        {
-            reference message = *messages.back();
-            messages.pop_back();
-
-            for (auto reply = message.replies.rbegin(), e = message.replies.rend();
-                reply != e; ++reply)
-            {
-                messages.push_back(&*reply);
-            }
-        }
-
-        bool operator==(const MessageTreeIterator & other) const
-        {
-            return messages.size() == other.messages.size() &&
-                (messages.size() == 0 || messages.back()->id == other.messages.back()->id);
-        }
-
-        bool operator!=(const MessageTreeIterator & other) const
-        {
-            return !operator==(other);
-        }
+        explicit MessageHandle(const std::string & id);
+        MessageHandle(MessageHandle && other);
+        MessageHandle(const MessageHandle &) = delete;
+        MessageHandle & operator=(const MessageHandle &) = delete;
+        ~MessageHandle();
+
+        const std::string & id() const { return _id; }
+
+        /**
+         * \throw InvalidMessageException if there is no such message.
+         */
+        std::string filename() const;
+        time_t date() const;
+
+        /**
+         * Returns the value of the header, or an empty string.
+         */
+        std::string header(const std::string & name) const;
+
+        TagSet tags() const;
+
+        /**
+         * Queues a tag change, see TagQueue.
+         *
+         * \param origin Identifies what made the change, see TagQueue::follow().
+         */
+        void addTag(const std::string & tag, const void * origin = NULL);
+        void removeTag(const std::string & tag, const void * origin = NULL);
 
     private:
-        std::vector<T *> messages;
-};
-
-
-class Message
-{
-    public:
-        typedef MessageTreeIterator<Message> iterator;
-        typedef MessageTreeIterator<const Message> const_iterator;
+        notmuch_message_t * message() const;
 
-        Message(notmuch_message_t * message);
-
-        void addTag(std::string tag);
-        void addTagRecursive(std::string tag);
-
-        void removeTag(std::string tag);
-        void removeTagRecursive(std::string tag);
-
-        std::string id;
-        std::string filename;
-
-        time_t date;
+        std::string _id;
 
-        std::map<std::string, std::string> headers;
-        std::set<std::string> tags;
-        std::vector<Message> replies;
+        mutable notmuch_database_t * _database;
+        mutable notmuch_message_t * _message;
 };
 
 #endif /* NER_MESSAGE_H */
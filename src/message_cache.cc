@@ -0,0 +1,162 @@
+/* ner: src/message_cache.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "message_cache.hh"
+#include "ner_config.hh"
+#include "util.hh"
+
+ParsedMessage::ParsedMessage(GMimeMessage * message)
+    : message(message)
+{
+    headers = {
+        { "To",         takeString(internet_address_list_to_string(g_mime_message_get_recipients(message,
+            GMIME_RECIPIENT_TYPE_TO), true), "(null)") },
+        { "From",       g_mime_message_get_sender(message) ? : "(null)" },
+        { "Cc",         takeString(internet_address_list_to_string(g_mime_message_get_recipients(message,
+            GMIME_RECIPIENT_TYPE_CC), true), "(null)") },
+        { "Bcc",        takeString(internet_address_list_to_string(g_mime_message_get_recipients(message,
+            GMIME_RECIPIENT_TYPE_BCC), true), "(null)") },
+        { "Subject",    g_mime_message_get_subject(message) ? : "(null)" }
+    };
+
+    /* Owned by the message */
+    GMimeObject * mimePart = g_mime_message_get_mime_part(message);
+
+    /* Locate plain text parts */
+    processMimePart(mimePart, std::back_inserter(parts));
+}
+
+ParsedMessage::~ParsedMessage()
+{
+    g_object_unref(message);
+}
+
+MessageCache & MessageCache::instance()
+{
+    static MessageCache * cache = NULL;
+
+    if (!cache)
+        cache = new MessageCache();
+
+    return *cache;
+}
+
+MessageCache::MessageCache()
+    : _size(0)
+{
+}
+
+std::shared_ptr<const ParsedMessage> MessageCache::get(const std::string & filename)
+{
+    struct stat status;
+
+    if (stat(filename.c_str(), &status) != 0)
+        return std::shared_ptr<const ParsedMessage>();
+
+    auto entry = find(filename, status);
+
+    if (entry != _entries.end())
+    {
+        _entries.splice(_entries.begin(), _entries, entry);
+        return entry->message;
+    }
+
+    auto message = parse(filename);
+
+    if (message)
+        insert(filename, status, message);
+
+    return message;
+}
+
+bool MessageCache::contains(const std::string & filename)
+{
+    struct stat status;
+
+    return stat(filename.c_str(), &status) == 0 &&
+        find(filename, status) != _entries.end();
+}
+
+void MessageCache::insert(const std::string & filename, const struct stat & status,
+    std::shared_ptr<const ParsedMessage> message)
+{
+    if (find(filename, status) != _entries.end())
+        return;
+
+    _entries.push_front(Entry{ filename, status.st_ino, status.st_mtim, status.st_size,
+        message });
+    _index[filename] = _entries.begin();
+    _size += status.st_size;
+
+    /* Views still showing a dropped message keep it until they are done */
+    std::size_t capacity = std::size_t(NerConfig::instance().messageCacheSize()) << 20;
+
+    while (_size > capacity && _entries.size() > 1)
+        remove(std::prev(_entries.end()));
+}
+
+std::shared_ptr<const ParsedMessage> MessageCache::parse(const std::string & filename,
+    bool map)
+{
+    GMimeStream * file = map ? openMessageFile(filename) : readMessageFile(filename);
+
+    if (file == NULL)
+        return std::shared_ptr<const ParsedMessage>();
+
+    auto stream = autoUnref(file);
+    auto parser = autoUnref(g_mime_parser_new_with_stream(stream));
+    GMimeMessage * message = g_mime_parser_construct_message(parser);
+
+    if (message == NULL)
+        return std::shared_ptr<const ParsedMessage>();
+
+    return std::make_shared<ParsedMessage>(message);
+}
+
+std::list<MessageCache::Entry>::iterator MessageCache::find(const std::string & filename,
+    const struct stat & status)
+{
+    auto indexEntry = _index.find(filename);
+
+    if (indexEntry == _index.end())
+        return _entries.end();
+
+    auto entry = indexEntry->second;
+
+    if (entry->inode == status.st_ino && entry->size == status.st_size &&
+        entry->modificationTime.tv_sec == status.st_mtim.tv_sec &&
+        entry->modificationTime.tv_nsec == status.st_mtim.tv_nsec)
+    {
+        return entry;
+    }
+
+    /* The file has changed since it was parsed */
+    remove(entry);
+
+    return _entries.end();
+}
+
+void MessageCache::remove(std::list<Entry>::iterator entry)
+{
+    _size -= entry->size;
+    _index.erase(entry->filename);
+    _entries.erase(entry);
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
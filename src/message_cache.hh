@@ -0,0 +1,130 @@
+/* ner: src/message_cache.hh
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NER_MESSAGE_CACHE_H
+#define NER_MESSAGE_CACHE_H 1
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <gmime/gmime.h>
+
+#include "message_part.hh"
+
+/**
+ * A message file, parsed into the headers and parts which are displayed.
+ */
+struct ParsedMessage
+{
+    ParsedMessage(GMimeMessage * message);
+    ParsedMessage(const ParsedMessage &) = delete;
+    ParsedMessage & operator=(const ParsedMessage &) = delete;
+    ~ParsedMessage();
+
+    GMimeMessage * message;
+
+    std::map<std::string, std::string> headers;
+    std::vector<std::shared_ptr<MessagePart>> parts;
+};
+
+/**
+ * A cache of parsed messages, shared by the views which display them.
+ *
+ * Messages are looked up by filename, and are parsed again if the file has
+ * been replaced or modified since. When the files of the cached messages
+ * add up to more than NerConfig::messageCacheSize(), the least recently used
+ * messages are dropped.
+ *
+ * The parts are shared by every view showing the message, so the lines
+ * decoded by one of them are kept for the others. Each view keeps track of
+ * which parts it has folded itself.
+ */
+class MessageCache
+{
+    public:
+        static MessageCache & instance();
+
+        /**
+         * Returns the message in filename, parsing it unless it is cached.
+         *
+         * \return NULL if the file cannot be opened.
+         */
+        std::shared_ptr<const ParsedMessage> get(const std::string & filename);
+
+        /**
+         * Whether the cached message in filename is current.
+         */
+        bool contains(const std::string & filename);
+
+        /**
+         * Adds a message which was parsed from filename when it had the
+         * given status, unless a current one is cached already.
+         */
+        void insert(const std::string & filename, const struct stat & status,
+            std::shared_ptr<const ParsedMessage> message);
+
+        /**
+         * Parses the message in filename without caching it. Unlike the
+         * rest of the cache, this can be called from any thread.
+         *
+         * \param map Whether the file may be mapped, see openMessageFile().
+         *     Otherwise it is read into memory, see readMessageFile().
+         * \return NULL if the file cannot be opened or parsed.
+         */
+        static std::shared_ptr<const ParsedMessage> parse(const std::string & filename,
+            bool map = true);
+
+    private:
+        MessageCache();
+
+        struct Entry
+        {
+            std::string filename;
+
+            /* Identifies the version of the file which was parsed */
+            ino_t inode;
+            struct timespec modificationTime;
+            off_t size;
+
+            std::shared_ptr<const ParsedMessage> message;
+        };
+
+        /**
+         * Returns the entry for filename if it was parsed from the file with
+         * the given status, dropping it otherwise.
+         */
+        std::list<Entry>::iterator find(const std::string & filename,
+            const struct stat & status);
+
+        void remove(std::list<Entry>::iterator entry);
+
+        /* The most recently used entry first */
+        std::list<Entry> _entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+
+        std::size_t _size;
+};
+
+#endif
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
@@ -18,15 +18,15 @@
  */
 
 #include "message_part.hh"
-#include "ner_config.hh"
 #include "gmime_iostream.hh"
 #include "message_part_visitor.hh"
+#include "html_renderer.hh"
+#include "util.hh"
 
-#include <sys/types.h>
-#include <sys/wait.h>
+#include <sstream>
 
 MessagePart::MessagePart(const std::string & id_)
-    : id(id_), folded(true)
+    : id(id_)
 {
 }
 
@@ -41,40 +41,18 @@ TextPart::TextPart(GMimePart * part)
     /* If this part is html text */
     if (g_mime_content_type_is_type(mimeContentType, "text", "html"))
     {
-        int readPipes[2];
-        int writePipes[2];
-
-        pipe(readPipes);
-        pipe(writePipes);
-
         GMimeDataWrapper * content = g_mime_part_get_content_object(part);
 
-        if (pid_t pid = fork())
-        {
-            close(writePipes[0]);
-            close(readPipes[1]);
-
-            GMimeStream * pipeStream = g_mime_stream_fs_new(writePipes[1]);
-            g_mime_data_wrapper_write_to_stream(content, pipeStream);
-            close(writePipes[1]);
+        GMimeStream * htmlStream = g_mime_stream_mem_new();
+        g_mime_data_wrapper_write_to_stream(content, htmlStream);
 
-            contentStream = g_mime_stream_fs_new(readPipes[0]);
-            g_mime_stream_fs_set_owner(GMIME_STREAM_FS(contentStream), true);
-
-            int status;
-            waitpid(pid, &status, 0);
-        }
-        else
-        {
-            close(readPipes[0]);
-            close(writePipes[1]);
+        /* Owned by the stream */
+        GByteArray * html = g_mime_stream_mem_get_byte_array(GMIME_STREAM_MEM(htmlStream));
 
-            dup2(readPipes[1], 1);
-            dup2(writePipes[0], 0);
+        _rendering = HtmlRenderer::instance().render(
+            std::string(reinterpret_cast<const char *>(html->data), html->len));
 
-            execlp("sh", "sh", "-c", NerConfig::instance().command("html").c_str(), NULL);
-            exit(0);
-        }
+        g_object_unref(htmlStream);
     }
     /* If this part is text */
     else if (g_mime_content_type_is_type(mimeContentType, "text", "*"))
@@ -83,7 +61,11 @@ TextPart::TextPart(GMimePart * part)
         const char * charset = g_mime_object_get_content_type_parameter(GMIME_OBJECT(part), "charset");
         GMimeStream * stream = g_mime_data_wrapper_get_stream(content);
 
-        GMimeStream * filteredStream = g_mime_stream_filter_new(stream);
+        /* Read through a substream of our own, so that other parts made from
+         * the same message, which may be decoding it too, keep their place. */
+        GMimeStream * source = g_mime_stream_substream(stream, stream->bound_start, stream->bound_end);
+        GMimeStream * filteredStream = g_mime_stream_filter_new(source);
+        g_object_unref(source);
 
         GMimeFilter * filter = g_mime_filter_basic_new(g_mime_data_wrapper_get_encoding(content), false);
         g_mime_stream_filter_add(GMIME_STREAM_FILTER(filteredStream), filter);
@@ -96,8 +78,6 @@ TextPart::TextPart(GMimePart * part)
             g_object_unref(filter);
         }
 
-        g_mime_stream_reset(stream);
-
         contentStream = filteredStream;
     }
     else
@@ -105,21 +85,56 @@ TextPart::TextPart(GMimePart * part)
         /* We don't know how to handle this part */
     }
 
+    if (_rendering)
+        return;
+
     if (contentStream == NULL)
         throw std::runtime_error(std::string("Cannot handle content type: ") +
             contentType);
 
-    GMimeIOStream stream(contentStream);
+    _stream.reset(new GMimeIOStream(contentStream));
     g_object_unref(contentStream);
+}
+
+TextPart::~TextPart()
+{
+}
 
-    while (stream.good())
+bool TextPart::pending() const
+{
+    return _rendering && !_rendering->done();
+}
+
+void TextPart::wait() const
+{
+    if (_rendering)
+        _rendering->wait();
+}
+
+bool TextPart::decode(std::size_t count) const
+{
+    if (_rendering)
+    {
+        if (!_rendering->done())
+            return lines.size() >= count;
+
+        _stream.reset(new std::istringstream(_rendering->text()));
+        _rendering.reset();
+    }
+
+    while (lines.size() < count && _stream)
     {
         std::string line;
-        std::getline(stream, line);
+        std::getline(*_stream, line);
         for (std::size_t tab = 0; (tab = line.find('\t', tab)) != std::string::npos; ++tab)
             line.replace(tab, 1, 8 - (tab % 8), ' ');
         lines.push_back(line);
+
+        if (!_stream->good())
+            _stream.reset();
     }
+
+    return lines.size() >= count;
 }
 
 void TextPart::accept(MessagePartVisitor & visitor)
@@ -130,8 +145,8 @@ void TextPart::accept(MessagePartVisitor & visitor)
 Attachment::Attachment(GMimePart * part)
     : MessagePart(g_mime_part_get_content_id(part) ? : std::string()),
         filename(g_mime_part_get_filename(part) ? : std::string()),
-        contentType(g_mime_content_type_to_string(
-            g_mime_object_get_content_type(GMIME_OBJECT(part)))),
+        contentType(takeString(g_mime_content_type_to_string(
+            g_mime_object_get_content_type(GMIME_OBJECT(part))))),
         data(g_mime_part_get_content_object(part))
 {
     g_object_ref(data);
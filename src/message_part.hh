@@ -22,6 +22,9 @@
 
 #include <string>
 #include <vector>
+#include <istream>
+#include <memory>
+#include <limits>
 #include <stdexcept>
 #include <gmime/gmime.h>
 
@@ -29,6 +32,7 @@
 #include "view.hh"
 
 class MessagePartVisitor;
+class HtmlRendering;
 
 struct MessagePart
 {
@@ -36,18 +40,52 @@ struct MessagePart
 
     virtual void accept(MessagePartVisitor & visitor) = 0;
 
-    bool folded;
     std::string id;
 };
 
+/**
+ * A text part, which is decoded as its lines are needed.
+ *
+ * Lines are appended to lines by decode(), so a part that is never displayed
+ * (for example because it stays folded) is never decoded. HTML parts are
+ * rendered by the HtmlRenderer, and have no lines until it is done.
+ */
 struct TextPart : public MessagePart
 {
     TextPart(GMimePart * part);
+    ~TextPart();
 
     virtual void accept(MessagePartVisitor & visitor);
 
-    std::vector<std::string> lines;
+    /**
+     * Decodes lines until there are at least count of them, or the whole part
+     * has been decoded.
+     *
+     * \return Whether lines holds at least count lines.
+     */
+    bool decode(std::size_t count = std::numeric_limits<std::size_t>::max()) const;
+
+    bool decoded() const { return !_stream && !_rendering; }
+
+    /**
+     * Whether the part is HTML which has not been rendered yet.
+     */
+    bool pending() const;
+
+    /**
+     * Waits until the part is no longer pending.
+     */
+    void wait() const;
+
+    mutable std::vector<std::string> lines;
     std::string contentType;
+
+    private:
+        /* The decoded content, until the end of the part has been reached */
+        mutable std::unique_ptr<std::istream> _stream;
+
+        /* The rendering of an HTML part, until decoding starts */
+        mutable std::shared_ptr<const HtmlRendering> _rendering;
 };
 
 struct Attachment : public MessagePart
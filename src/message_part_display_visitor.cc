@@ -26,16 +26,21 @@
 #include "util.hh"
 
 const int wrapWidth(80);
+const std::string renderingMessage("[rendering HTML...]");
 
 MessagePartDisplayVisitor::MessagePartDisplayVisitor(WINDOW * window,
-    const View::Geometry & area, int offset, int selection, bool displayPartName)
+    const View::Geometry & area, int offset, int selection, bool displayPartName,
+    const std::set<const MessagePart *> & unfoldedParts)
     : _window(window), _area(area), _offset(offset), _row(area.y), _messageRow(0),
-        _selection(selection), _displayPartName(displayPartName)
+        _selection(selection), _decodeLimit(offset + 2 * area.height),
+        _displayPartName(displayPartName), _unfoldedParts(unfoldedParts)
 {
 }
 
 void MessagePartDisplayVisitor::visit(const TextPart & part)
 {
+    bool folded = !_unfoldedParts.count(&part);
+
     if (_messageRow >= _offset && _row < _area.y + _area.height && _displayPartName)
     {
         bool selected = _messageRow == _selection;
@@ -44,7 +49,7 @@ void MessagePartDisplayVisitor::visit(const TextPart & part)
         wmove(_window, _row++, _area.x);
 
         attr_t attributes = 0;
-        x += NCurses::addChar(_window, part.folded ? '+' : '-',
+        x += NCurses::addChar(_window, folded ? '+' : '-',
                               A_BOLD | attributes, ColorID::AttachmentFilename);
         NCurses::checkMove(_window, ++x);
 
@@ -62,11 +67,43 @@ void MessagePartDisplayVisitor::visit(const TextPart & part)
         NCurses::checkMove(_window, x - 1);
         ++_messageRow;
     }
-    if (part.folded)
+    if (folded)
+        return;
+
+    if (part.pending())
+    {
+        if (_messageRow >= _offset && _row < _area.y + _area.height)
+        {
+            wmove(_window, _row++, _area.x + 2);
+
+            attr_t attributes = 0;
+
+            if (_messageRow == _selection)
+            {
+                attributes |= A_REVERSE;
+                wchgat(_window, _area.width - 2, A_REVERSE, 0, NULL);
+            }
+
+            NCurses::addPlainString(_window, renderingMessage, attributes,
+                ColorID::AttachmentMimeType);
+        }
+
+        ++_messageRow;
         return;
+    }
 
-    for (auto line = part.lines.begin(), e = part.lines.end(); line != e; ++line)
+    for (std::size_t index = 0;; ++index)
     {
+        /* Only decode up to a page past the window, the rest is decoded as
+         * the user scrolls down to it. */
+        if (index == part.lines.size() &&
+            (_messageRow >= _decodeLimit || !part.decode(index + 1)))
+        {
+            break;
+        }
+
+        auto line = part.lines.begin() + index;
+
         unsigned citationLevel = 0;
         for (auto character = line->begin(); character != line->end(); ++character)
         {
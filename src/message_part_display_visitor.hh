@@ -20,15 +20,24 @@
 #ifndef NER_MESSAGE_PART_DISPLAY_VISITOR_H
 #define NER_MESSAGE_PART_DISPLAY_VISITOR_H 1
 
+#include <set>
+
 #include "message_part_visitor.hh"
 #include "ncurses.hh"
 #include "view.hh"
 
+struct MessagePart;
+
 class MessagePartDisplayVisitor : public MessagePartVisitor
 {
     public:
+        /**
+         * \param unfoldedParts The parts whose lines are shown, the others
+         *     are folded.
+         */
         MessagePartDisplayVisitor(WINDOW * window, const View::Geometry & area,
-            int offset, int selection, bool displayPartName);
+            int offset, int selection, bool displayPartName,
+            const std::set<const MessagePart *> & unfoldedParts);
 
         virtual void visit(const TextPart & part);
         virtual void visit(const Attachment & part);
@@ -44,7 +53,12 @@ class MessagePartDisplayVisitor : public MessagePartVisitor
         int _offset;
         int _selection;
 
+        /* The row past which no more lines are decoded */
+        int _decodeLimit;
+
         bool _displayPartName;
+
+        const std::set<const MessagePart *> & _unfoldedParts;
 };
 
 #endif
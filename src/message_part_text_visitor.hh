@@ -21,6 +21,7 @@
 #define NER_MESSAGE_PART_TEXT_VISITOR_H 1
 
 #include "message_part_visitor.hh"
+#include "message_part.hh"
 
 template <class OutputIterator>
     class MessagePartTextVisitor : public MessagePartVisitor
@@ -33,6 +34,8 @@ template <class OutputIterator>
 
         virtual void visit(const TextPart & part)
         {
+            part.wait();
+            part.decode();
             _iterator = std::copy(part.lines.begin(), part.lines.end(), _iterator);
         }
 
@@ -0,0 +1,168 @@
+/* ner: src/message_prefetcher.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "message_prefetcher.hh"
+#include "ner_config.hh"
+
+/* The number of lines decoded from the first part of each message, about
+ * enough to fill the screen */
+const std::size_t prefetchedLines = 100;
+
+MessagePrefetcher::MessagePrefetcher()
+    : _stopping(false), _request(0), _messages(16)
+{
+    _thread = std::thread(std::bind(&MessagePrefetcher::run, this));
+}
+
+MessagePrefetcher::~MessagePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        ++_request;
+    }
+
+    _wakeup.notify_one();
+    _thread.join();
+}
+
+void MessagePrefetcher::prefetch(const std::vector<std::string> & filenames)
+{
+    MessageCache & cache = MessageCache::instance();
+    std::vector<std::string> uncached;
+
+    for (auto filename = filenames.begin(), e = filenames.end(); filename != e; ++filename)
+    {
+        if (!cache.contains(*filename))
+            uncached.push_back(*filename);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _filenames.swap(uncached);
+        ++_request;
+    }
+
+    _wakeup.notify_one();
+}
+
+void MessagePrefetcher::collect()
+{
+    std::unique_ptr<Message> message;
+    bool collected = false;
+
+    while (_messages.pop(message))
+    {
+        MessageCache::instance().insert(message->filename, message->status, message->message);
+        collected = true;
+    }
+
+    if (!collected)
+        return;
+
+    /* Take the lock, so the worker is either waiting for room already, or
+     * will find it when it checks */
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+    }
+
+    _wakeup.notify_one();
+}
+
+void MessagePrefetcher::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        _wakeup.wait(lock, [this] { return _stopping || !_filenames.empty(); });
+
+        if (_stopping)
+            return;
+
+        std::vector<std::string> filenames;
+        filenames.swap(_filenames);
+        unsigned request = _request;
+
+        lock.unlock();
+        prefetchFiles(filenames, request);
+        lock.lock();
+    }
+}
+
+void MessagePrefetcher::prefetchFiles(const std::vector<std::string> & filenames, unsigned request)
+{
+    off_t budget = off_t(NerConfig::instance().messagePrefetchSize()) << 20;
+    std::vector<std::pair<std::string, struct stat>> files;
+
+    /* Have all of the files read in while the first ones are parsed */
+    for (auto filename = filenames.begin(), e = filenames.end(); filename != e; ++filename)
+    {
+        int fd = open(filename->c_str(), O_RDONLY);
+
+        if (fd == -1)
+            continue;
+
+        struct stat status;
+
+        if (fstat(fd, &status) == 0 && status.st_size <= budget)
+        {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+            files.push_back(std::make_pair(*filename, status));
+            budget -= status.st_size;
+        }
+
+        close(fd);
+    }
+
+    for (auto file = files.begin(), e = files.end(); file != e && _request == request; ++file)
+    {
+        std::unique_ptr<Message> message(new Message{ file->first, file->second,
+            MessageCache::parse(file->first) });
+
+        if (!message->message)
+            continue;
+
+        /* EmailView shows the first part unfolded */
+        auto & parts = message->message->parts;
+
+        if (!parts.empty())
+        {
+            if (TextPart * part = dynamic_cast<TextPart *>(parts.front().get()))
+                part->decode(prefetchedLines);
+        }
+
+        /* The main thread empties the queue when it moves to another
+         * message, so only give up once the request is superseded */
+        if (!_messages.push(message))
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _wakeup.wait(lock, [this, request, &message] {
+                return _request != request || _messages.push(message);
+            });
+        }
+    }
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
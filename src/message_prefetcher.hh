@@ -0,0 +1,98 @@
+/* ner: src/message_prefetcher.hh
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NER_MESSAGE_PREFETCHER_H
+#define NER_MESSAGE_PREFETCHER_H 1
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <sys/stat.h>
+
+#include "spsc_queue.hh"
+#include "message_cache.hh"
+
+/**
+ * Parses messages in the background, ahead of them being read.
+ *
+ * A worker thread asks the kernel to read the files in, then parses them and
+ * decodes the start of their first part. The parsed messages are added to the
+ * MessageCache by collect(), on the main thread.
+ */
+class MessagePrefetcher
+{
+    public:
+        MessagePrefetcher();
+        MessagePrefetcher(const MessagePrefetcher &) = delete;
+        MessagePrefetcher & operator=(const MessagePrefetcher &) = delete;
+        ~MessagePrefetcher();
+
+        /**
+         * Starts prefetching the given files in order, skipping those which
+         * are cached, and abandoning those of the previous call which are
+         * not parsed yet.
+         */
+        void prefetch(const std::vector<std::string> & filenames);
+
+        /**
+         * Adds the messages which have been parsed to the cache.
+         */
+        void collect();
+
+    private:
+        struct Message
+        {
+            std::string filename;
+            struct stat status;
+            std::shared_ptr<const ParsedMessage> message;
+        };
+
+        /**
+         * Runs in the worker thread until the prefetcher is destroyed.
+         */
+        void run();
+
+        void prefetchFiles(const std::vector<std::string> & filenames, unsigned request);
+
+        std::thread _thread;
+
+        /* Guards _filenames, _stopping and changes to _request. The worker
+         * is woken for a new request, and when collect() makes room in
+         * _messages. */
+        std::mutex _mutex;
+        std::condition_variable _wakeup;
+
+        /* The files of the latest request, until the worker takes them */
+        std::vector<std::string> _filenames;
+        bool _stopping;
+
+        /* Counts the requests, so the worker can tell when its files have
+         * been superseded */
+        std::atomic<unsigned> _request;
+
+        SpscQueue<std::unique_ptr<Message>> _messages;
+};
+
+#endif
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
@@ -0,0 +1,209 @@
+/* ner: src/message_tree.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <algorithm>
+
+#include "message_tree.hh"
+#include "notmuch.hh"
+
+MessageTree::MessageTree()
+    : _database(NULL), _foldDepth(-1)
+{
+}
+
+MessageTree::~MessageTree()
+{
+    clear();
+}
+
+void MessageTree::load(notmuch_database_t * database, const std::string & threadId,
+    int foldDepth, int foldSize)
+{
+    clear();
+
+    _database = database;
+
+    notmuch_thread_t * thread = Notmuch::thread(threadId, _query, database);
+
+    if (foldDepth > 0)
+        _foldDepth = foldDepth;
+
+    if (foldSize > 0 && notmuch_thread_get_total_messages(thread) > foldSize)
+        _foldDepth = _foldDepth == -1 ? 1 : std::min(_foldDepth, 1);
+
+    /* Walk the replies depth first, keeping an iterator for each level rather
+     * than recursing, since threads can be arbitrarily deep */
+    struct Level
+    {
+        notmuch_messages_t * messages;
+        int parent;
+        int lastChild;
+    };
+
+    std::vector<Level> levels{ { notmuch_thread_get_toplevel_messages(thread), -1, -1 } };
+
+    while (!levels.empty())
+    {
+        Level & level = levels.back();
+
+        if (!notmuch_messages_valid(level.messages))
+        {
+            notmuch_messages_destroy(level.messages);
+            levels.pop_back();
+            continue;
+        }
+
+        notmuch_message_t * message = notmuch_messages_get(level.messages);
+        notmuch_messages_move_to_next(level.messages);
+
+        int index = addNode(message, level.parent, level.lastChild);
+        level.lastChild = index;
+
+        if (!_nodes[index].folded)
+        {
+            _nodes[index].loaded = true;
+            levels.push_back({ notmuch_message_get_replies(message), index, -1 });
+        }
+    }
+}
+
+void MessageTree::clear()
+{
+    _nodes.clear();
+    _ids.clear();
+    _senders.clear();
+
+    _foldDepth = -1;
+
+    _query.reset();
+
+    if (_database)
+    {
+        Notmuch::releaseDatabase(_database);
+        _database = NULL;
+    }
+}
+
+void MessageTree::setFolded(int index, bool folded)
+{
+    if (!folded && !_nodes[index].loaded)
+        loadReplies(index);
+
+    _nodes[index].folded = folded;
+}
+
+int MessageTree::addNode(notmuch_message_t * message, int parent, int previousSibling)
+{
+    int index = _nodes.size();
+
+    Node node;
+    node.message = message;
+    node.parent = parent;
+    node.firstChild = -1;
+    node.nextSibling = -1;
+    node.depth = parent == -1 ? 0 : _nodes[parent].depth + 1;
+    node.replyCount = 0;
+    node.date = notmuch_message_get_date(message);
+
+    const char * id = notmuch_message_get_message_id(message);
+    node.id = _ids.size();
+    _ids.insert(_ids.end(), id, id + std::strlen(id) + 1);
+
+    TagDictionary & dictionary = TagDictionary::instance();
+
+    notmuch_tags_t * tagIterator;
+    for (tagIterator = notmuch_message_get_tags(message);
+        notmuch_tags_valid(tagIterator);
+        notmuch_tags_move_to_next(tagIterator))
+    {
+        node.tags.insert(dictionary.intern(notmuch_tags_get(tagIterator)));
+    }
+    notmuch_tags_destroy(tagIterator);
+
+    /* Counting the replies only walks the list notmuch already built */
+    notmuch_messages_t * replies;
+    for (replies = notmuch_message_get_replies(message);
+        notmuch_messages_valid(replies);
+        notmuch_messages_move_to_next(replies))
+    {
+        ++node.replyCount;
+    }
+    notmuch_messages_destroy(replies);
+
+    node.loaded = node.replyCount == 0;
+    node.folded = !node.loaded && _foldDepth != -1 && node.depth >= _foldDepth;
+
+    _nodes.push_back(std::move(node));
+    _senders.push_back(std::string());
+
+    if (previousSibling != -1)
+        _nodes[previousSibling].nextSibling = index;
+    else if (parent != -1)
+        _nodes[parent].firstChild = index;
+
+    return index;
+}
+
+void MessageTree::loadReplies(int index)
+{
+    int lastChild = -1;
+
+    notmuch_messages_t * replies;
+    for (replies = notmuch_message_get_replies(_nodes[index].message);
+        notmuch_messages_valid(replies);
+        notmuch_messages_move_to_next(replies))
+    {
+        lastChild = addNode(notmuch_messages_get(replies), index, lastChild);
+    }
+    notmuch_messages_destroy(replies);
+
+    _nodes[index].loaded = true;
+}
+
+const std::string & MessageTree::sender(int index)
+{
+    std::string & sender = _senders[index];
+
+    if (sender.empty())
+    {
+        sender = notmuch_message_get_header(_nodes[index].message, "From") ? : "(null)";
+    }
+
+    return sender;
+}
+
+std::string MessageTree::filename(int index) const
+{
+    return notmuch_message_get_filename(_nodes[index].message);
+}
+
+int MessageTree::find(const std::string & id) const
+{
+    for (int index = 0; index < size(); ++index)
+    {
+        if (id == this->id(index))
+            return index;
+    }
+
+    return -1;
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
+
@@ -0,0 +1,151 @@
+/* ner: src/message_tree.hh
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NER_MESSAGE_TREE_H
+#define NER_MESSAGE_TREE_H 1
+
+#include <string>
+#include <vector>
+#include <time.h>
+#include <stdint.h>
+
+#include "tag_set.hh"
+#include "notmuch.hh"
+
+#include <notmuch.h>
+
+/**
+ * The messages of a thread, flattened into an array and linked into a tree.
+ *
+ * Only the fields needed to lay out the tree are read up front. Headers are
+ * looked up the first time they are asked for, and the replies to a folded
+ * message are only loaded once it is unfolded, so the thread's query is kept
+ * open until the tree is cleared.
+ */
+class MessageTree
+{
+    public:
+        MessageTree();
+        MessageTree(const MessageTree &) = delete;
+        MessageTree & operator=(const MessageTree &) = delete;
+        ~MessageTree();
+
+        /**
+         * Replaces the contents with the messages of the thread with the given
+         * ID, taking over database until the tree is cleared.
+         *
+         * Messages at foldDepth or deeper start folded, as do those below the
+         * top level if the thread has more than foldSize messages. Either
+         * limit is ignored if it is 0.
+         */
+        void load(notmuch_database_t * database, const std::string & threadId,
+            int foldDepth, int foldSize);
+        void clear();
+
+        int size() const { return _nodes.size(); }
+        bool empty() const { return _nodes.empty(); }
+
+        const char * id(int index) const { return &_ids[_nodes[index].id]; }
+
+        /* These return -1 if there is no such message */
+        int parent(int index) const { return _nodes[index].parent; }
+        int firstChild(int index) const { return _nodes[index].firstChild; }
+        int nextSibling(int index) const { return _nodes[index].nextSibling; }
+
+        int depth(int index) const { return _nodes[index].depth; }
+
+        /**
+         * Whether the replies to the message at index are hidden. Unfolding a
+         * message loads its replies the first time.
+         */
+        bool folded(int index) const { return _nodes[index].folded; }
+        void setFolded(int index, bool folded);
+
+        int replyCount(int index) const { return _nodes[index].replyCount; }
+        time_t date(int index) const { return _nodes[index].date; }
+
+        TagSet & tags(int index) { return _nodes[index].tags; }
+        const TagSet & tags(int index) const { return _nodes[index].tags; }
+
+        /**
+         * The From header of the message at index, looked up the first time
+         * it is needed.
+         */
+        const std::string & sender(int index);
+
+        /**
+         * The file of the message at index.
+         */
+        std::string filename(int index) const;
+
+        /**
+         * The index of the message with the given ID, or -1.
+         */
+        int find(const std::string & id) const;
+
+    private:
+        struct Node
+        {
+            /* Valid while _query is */
+            notmuch_message_t * message;
+
+            /* The offset of the ID in _ids */
+            uint32_t id;
+
+            int parent;
+            int firstChild;
+            int nextSibling;
+            int depth;
+
+            int replyCount;
+            bool folded;
+            bool loaded;
+
+            time_t date;
+            TagSet tags;
+        };
+
+        /**
+         * Adds a node for message after previousSibling, or as the first
+         * child of parent if there is none, and returns its index.
+         */
+        int addNode(notmuch_message_t * message, int parent, int previousSibling);
+
+        /**
+         * Adds nodes for the replies to the message at index.
+         */
+        void loadReplies(int index);
+
+        notmuch_database_t * _database;
+        Notmuch::QueryPointer _query;
+
+        /* Messages this deep start folded, or -1 */
+        int _foldDepth;
+
+        std::vector<Node> _nodes;
+        std::vector<char> _ids;
+
+        /* Empty until looked up */
+        std::vector<std::string> _senders;
+};
+
+#endif
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
+
@@ -35,6 +35,11 @@
 #include "notmuch.hh"
 #include "line_editor.hh"
 #include "message.hh"
+#include "ner_config.hh"
+#include "tag_queue.hh"
+
+/* How often to update busy views while waiting for input, in milliseconds */
+const int busyTimeout = 100;
 
 Ner::Ner()
 {
@@ -94,10 +99,35 @@ void Ner::run()
 
     _viewManager.refresh();
 
+    /* Refresh the view every minute (or when the user presses a key). */
+    int idleTimeout = NerConfig::instance().refreshView() ? 60000 : -1;
+
     while (_running)
     {
+        TagQueue & tagQueue = TagQueue::instance();
+
+        /* Keep an eye on the tag writer while it has changes to write, so a
+         * failure is reported promptly */
+        timeout(_viewManager.activeView().busy() || tagQueue.pending() ?
+            busyTimeout : idleTimeout);
+
         int key = getch();
 
+        std::string error = tagQueue.takeError();
+
+        if (!error.empty())
+            _statusBar.displayMessage(error);
+
+        /* Nothing was typed before the timeout, so leave any partial key
+         * sequence alone, and only show what has arrived in the meantime */
+        if (key == ERR)
+        {
+            _viewManager.update();
+            _viewManager.refresh();
+
+            continue;
+        }
+
         if (key == KEY_BACKSPACE && sequence.size() > 0)
             sequence.pop_back();
         else if (key == 'c' - 96) // Ctrl-C
@@ -76,6 +76,14 @@ void NerConfig::load()
     _sortMode = NOTMUCH_SORT_NEWEST_FIRST;
     _refreshView = true;
     _addSigDashes = true;
+    _virtualSearch = false;
+    _searchPrefetch = 100;
+    _searchShards = 1;
+    _threadFoldDepth = 0;
+    _threadFoldSize = 1000;
+    _messageCacheSize = 32;
+    _messagePrefetchDepth = 2;
+    _messagePrefetchSize = 8;
     _commands.clear();
 
     std::map<ColorID, Color> colorMap = defaultColorMap;
@@ -128,6 +136,46 @@ void NerConfig::load()
 
             if (addSigDashesNode)
                 *addSigDashesNode >> _addSigDashes;
+
+            auto virtualSearchNode = general->FindValue("virtual_search");
+
+            if (virtualSearchNode)
+                *virtualSearchNode >> _virtualSearch;
+
+            auto searchPrefetchNode = general->FindValue("search_prefetch");
+
+            if (searchPrefetchNode)
+                *searchPrefetchNode >> _searchPrefetch;
+
+            auto searchShardsNode = general->FindValue("search_shards");
+
+            if (searchShardsNode)
+                *searchShardsNode >> _searchShards;
+
+            auto threadFoldDepthNode = general->FindValue("thread_fold_depth");
+
+            if (threadFoldDepthNode)
+                *threadFoldDepthNode >> _threadFoldDepth;
+
+            auto threadFoldSizeNode = general->FindValue("thread_fold_size");
+
+            if (threadFoldSizeNode)
+                *threadFoldSizeNode >> _threadFoldSize;
+
+            auto messageCacheSizeNode = general->FindValue("message_cache_size");
+
+            if (messageCacheSizeNode)
+                *messageCacheSizeNode >> _messageCacheSize;
+
+            auto messagePrefetchDepthNode = general->FindValue("message_prefetch_depth");
+
+            if (messagePrefetchDepthNode)
+                *messagePrefetchDepthNode >> _messagePrefetchDepth;
+
+            auto messagePrefetchSizeNode = general->FindValue("message_prefetch_size");
+
+            if (messagePrefetchSizeNode)
+                *messagePrefetchSizeNode >> _messagePrefetchSize;
         }
 
         /* Commands */
@@ -272,6 +320,46 @@ bool NerConfig::addSigDashes() const
     return _addSigDashes;
 }
 
+bool NerConfig::virtualSearch() const
+{
+    return _virtualSearch;
+}
+
+int NerConfig::searchPrefetch() const
+{
+    return _searchPrefetch;
+}
+
+int NerConfig::searchShards() const
+{
+    return _searchShards;
+}
+
+int NerConfig::threadFoldDepth() const
+{
+    return _threadFoldDepth;
+}
+
+int NerConfig::threadFoldSize() const
+{
+    return _threadFoldSize;
+}
+
+int NerConfig::messageCacheSize() const
+{
+    return _messageCacheSize;
+}
+
+int NerConfig::messagePrefetchDepth() const
+{
+    return _messagePrefetchDepth;
+}
+
+int NerConfig::messagePrefetchSize() const
+{
+    return _messagePrefetchSize;
+}
+
 const std::map<std::string, std::string> NerConfig::getGeneralKeyMap()
 {
     return _generalKeys;
@@ -43,6 +43,25 @@ class NerConfig
 
         bool addSigDashes() const;
 
+        bool virtualSearch() const;
+        int searchPrefetch() const;
+        int searchShards() const;
+
+        int threadFoldDepth() const;
+        int threadFoldSize() const;
+
+        /**
+         * The size of the cache of parsed messages, in megabytes.
+         */
+        int messageCacheSize() const;
+
+        /**
+         * How many messages on either side of the one being read are parsed
+         * ahead of time, and the most megabytes of them to read.
+         */
+        int messagePrefetchDepth() const;
+        int messagePrefetchSize() const;
+
         const std::map<std::string, std::string> getGeneralKeyMap();
         const std::map<std::string, std::string> getMainKeyMap();
         const std::map<std::string, std::string> getEmailKeyMap();
@@ -63,6 +82,14 @@ class NerConfig
         notmuch_sort_t _sortMode;
         bool _refreshView;
         bool _addSigDashes;
+        bool _virtualSearch;
+        int _searchPrefetch;
+        int _searchShards;
+        int _threadFoldDepth;
+        int _threadFoldSize;
+        int _messageCacheSize;
+        int _messagePrefetchDepth;
+        int _messagePrefetchSize;
 };
 
 #endif
@@ -18,17 +18,40 @@
  */
 
 #include <stdexcept>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
 #include <glib-object.h>
 
+#include "config.h"
 #include "notmuch.hh"
+#include "tag_set.hh"
+#include "util.hh"
 
 GKeyFile * _config = NULL;
-notmuch_database_t * _notmuchDatabase = NULL;
 
-notmuch_database_t * Notmuch::openDatabase(notmuch_database_mode_t mode)
+std::string _databasePath;
+
+const std::size_t maxPooledDatabases = 4;
+
+/* How long a pooled handle is reused for, since another client may change the
+ * database without ner noticing */
+const std::chrono::seconds maxPooledAge(10);
+
+struct PooledDatabase
 {
-    return _notmuchDatabase;
-}
+    unsigned long revision;
+    std::chrono::steady_clock::time_point opened;
+};
+
+/* The idle read-only handles, the revision and time each open handle was
+ * opened at, and the latest revision seen, all guarded by _poolMutex */
+std::mutex _poolMutex;
+std::vector<notmuch_database_t *> _pool;
+std::map<notmuch_database_t *, PooledDatabase> _openedAt;
+unsigned long _latestRevision = 0;
 
 GKeyFile * Notmuch::config()
 {
@@ -42,85 +65,294 @@ void Notmuch::initializeDatabase(const std::string & path)
         throw new std::string("Couldn't load config file");
 
     char * db = g_key_file_get_string(_config, "database", "path", NULL);
-    notmuch_status_t s = notmuch_database_open(db, NOTMUCH_DATABASE_MODE_READ_WRITE, &_notmuchDatabase);
-    if (s != NOTMUCH_STATUS_SUCCESS) {
-        throw std::runtime_error("Open database failed: "+std::string(notmuch_status_to_string(s)));
+    _databasePath = db ? : "";
+    g_free(db);
+
+    notmuch_database_t * database = readonlyDatabase();
+
+    /* Intern the existing tags up front, so they are numbered alphabetically */
+    notmuch_tags_t * tags;
+    for (tags = notmuch_database_get_all_tags(database);
+        notmuch_tags_valid(tags);
+        notmuch_tags_move_to_next(tags))
+    {
+        TagDictionary::instance().intern(notmuch_tags_get(tags));
     }
+    notmuch_tags_destroy(tags);
+
+    releaseDatabase(database);
 }
 
 notmuch_database_t * Notmuch::readonlyDatabase()
 {
-    char * db = g_key_file_get_string(_config, "database", "path", NULL);
+    auto now = std::chrono::steady_clock::now();
+    std::vector<notmuch_database_t *> stale;
+    notmuch_database_t * ret = NULL;
 
-    notmuch_database_t * ret;
-    notmuch_status_t s = notmuch_database_open(db, NOTMUCH_DATABASE_MODE_READ_ONLY, &ret);
+    {
+        std::lock_guard<std::mutex> lock(_poolMutex);
+
+        while (!_pool.empty() && !ret)
+        {
+            const PooledDatabase & pooled = _openedAt[_pool.back()];
+
+            /* Reopen the handles which were opened before the last change */
+            if (pooled.revision == _latestRevision && now - pooled.opened < maxPooledAge)
+                ret = _pool.back();
+            else
+            {
+                stale.push_back(_pool.back());
+                _openedAt.erase(_pool.back());
+            }
+
+            _pool.pop_back();
+        }
+    }
+
+    for (auto database = stale.begin(), e = stale.end(); database != e; ++database)
+        notmuch_database_close(*database);
+
+    if (ret)
+        return ret;
+
+    notmuch_status_t s = notmuch_database_open(_databasePath.c_str(), NOTMUCH_DATABASE_MODE_READ_ONLY, &ret);
     if (s != NOTMUCH_STATUS_SUCCESS) {
         throw std::runtime_error("Open database failed: "+std::string(notmuch_status_to_string(s)));
     }
 
+    unsigned long openedRevision = revision(ret);
+
+    std::lock_guard<std::mutex> lock(_poolMutex);
+    _openedAt[ret] = PooledDatabase{ openedRevision, now };
+    _latestRevision = std::max(_latestRevision, openedRevision);
+
     return ret;
 }
 
-void Notmuch::closeDatabase()
+void Notmuch::releaseDatabase(notmuch_database_t * database)
 {
-    notmuch_database_close(_notmuchDatabase);
+#if HAVE_NOTMUCH_DATABASE_GET_REVISION
+    {
+        std::lock_guard<std::mutex> lock(_poolMutex);
+
+        if (_pool.size() < maxPooledDatabases)
+        {
+            _pool.push_back(database);
+            return;
+        }
+
+        _openedAt.erase(database);
+    }
+#else
+    /* Without revisions, we can't tell when a handle goes out of date, so
+     * don't keep any */
+    {
+        std::lock_guard<std::mutex> lock(_poolMutex);
+        _openedAt.erase(database);
+    }
+#endif
+
+    notmuch_database_close(database);
+}
+
+notmuch_database_t * Notmuch::openWritableDatabase()
+{
+    notmuch_database_t * database;
+    notmuch_status_t s = notmuch_database_open(_databasePath.c_str(), NOTMUCH_DATABASE_MODE_READ_WRITE, &database);
+    if (s != NOTMUCH_STATUS_SUCCESS) {
+        throw std::runtime_error("Open database failed: "+std::string(notmuch_status_to_string(s)));
+    }
+
+    return database;
 }
 
+void Notmuch::closeWritableDatabase(notmuch_database_t * database)
+{
+    unsigned long writtenRevision = revision(database);
+
+    notmuch_database_close(database);
+
+    std::lock_guard<std::mutex> lock(_poolMutex);
+    _latestRevision = std::max(_latestRevision, writtenRevision);
+}
 
-unsigned Notmuch::countMessages(std::string query)
+unsigned long Notmuch::revision(notmuch_database_t * database, std::string * uuid)
 {
-    unsigned ret;
+#if HAVE_NOTMUCH_DATABASE_GET_REVISION
+    const char * databaseUuid;
+    unsigned long revision = notmuch_database_get_revision(database, &databaseUuid);
 
-    notmuch_query_t * x = notmuch_query_create(_notmuchDatabase,query.c_str());
-    ret = notmuch_query_count_messages(x);
-    notmuch_query_destroy(x);
+    if (uuid)
+        *uuid = databaseUuid;
 
-    return ret;
+    return revision;
+#else
+    return 0;
+#endif
+}
+
+void Notmuch::closeDatabase()
+{
+    std::lock_guard<std::mutex> lock(_poolMutex);
+
+    for (auto database = _pool.begin(), e = _pool.end(); database != e; ++database)
+        notmuch_database_close(*database);
+
+    _pool.clear();
+    _openedAt.clear();
 }
 
-std::vector<Thread> & Notmuch::searchThreads(std::string query)
+
+unsigned Notmuch::countMessages(std::string query, notmuch_database_t * database)
 {
+    unsigned ret;
+
+    notmuch_database_t * current = database ? : readonlyDatabase();
+    QueryPointer x(notmuch_query_create(current,query.c_str()));
+    ret = notmuch_query_count_messages(x.get());
+
+    if (!database)
+        releaseDatabase(current);
+
+    return ret;
 }
 
-notmuch_thread_t * Notmuch::thread(std::string id, notmuch_query_t ** queryp)
+notmuch_thread_t * Notmuch::thread(std::string id, QueryPointer & query,
+    notmuch_database_t * database)
 {
-    const char * queryString = ("thread:" + id).c_str();
-    notmuch_query_t * query = notmuch_query_create(_notmuchDatabase, queryString);
-    notmuch_threads_t * threads = notmuch_query_search_threads(query);
+    std::string queryString("thread:" + id);
+    QueryPointer threadQuery(notmuch_query_create(database, queryString.c_str()));
+    notmuch_threads_t * threads = notmuch_query_search_threads(threadQuery.get());
 
     notmuch_thread_t * thread = NULL;
     if (notmuch_threads_valid(threads) && !!(thread = notmuch_threads_get(threads))) {
-        *queryp = query;
+        query = std::move(threadQuery);
         return thread;
     }
 
-    notmuch_query_destroy(query);
     throw InvalidThreadException(id);
 }
 
-Thread & Notmuch::getThread(std::string id)
+Thread Notmuch::getThread(std::string id, notmuch_database_t * database)
 {
-    notmuch_query_t * query = NULL;
-    notmuch_thread_t * thread = Notmuch::thread(id, &query);
-
-    Thread & ret = *(new Thread(thread));
-    notmuch_query_destroy(query);
+    QueryPointer query;
 
-    return ret;
+    return Thread(Notmuch::thread(id, query, database));
 }
 
-notmuch_message_t * Notmuch::message(std::string id)
+Notmuch::MessagePointer Notmuch::message(std::string id, notmuch_database_t * database)
 {
     notmuch_message_t * message = NULL;
-    notmuch_database_find_message(_notmuchDatabase, id.c_str(), &message);
+    notmuch_database_find_message(database, id.c_str(), &message);
 
     if (message == NULL)
         throw InvalidMessageException(id);
 
-    return message;
+    return MessagePointer(message);
+}
+
+void Notmuch::TagTransaction::changeMessageTag(const std::string & messageId,
+    const std::string & tag, bool add)
+{
+    if (!tag.empty())
+        _changes.push_back({ false, messageId, tag, add });
+}
+
+void Notmuch::TagTransaction::changeThreadTag(const std::string & threadId,
+    const std::string & tag, bool add)
+{
+    if (!tag.empty())
+        _changes.push_back({ true, threadId, tag, add });
 }
 
-Message & Notmuch::getMessage(std::string id)
+void Notmuch::TagTransaction::commit(notmuch_database_t * database)
 {
-    return *(new Message(Notmuch::message(id)));
+    std::vector<Change> changes;
+    changes.swap(_changes);
+
+    std::string missingMessage, missingThread;
+
+    notmuch_status_t status = notmuch_database_begin_atomic(database);
+
+    if (status != NOTMUCH_STATUS_SUCCESS)
+        throw std::runtime_error("Couldn't write tags: " + std::string(notmuch_status_to_string(status)));
+
+    /* Gather the changes of each message in order, expanding those made to
+     * threads into their messages */
+    std::map<std::string, std::vector<std::string>> threads;
+    std::map<std::string, std::vector<const Change *>> messages;
+
+    for (auto change = changes.begin(), e = changes.end(); change != e; ++change)
+    {
+        if (!change->thread)
+        {
+            messages[change->id].push_back(&*change);
+            continue;
+        }
+
+        auto thread = threads.find(change->id);
+
+        if (thread == threads.end())
+        {
+            thread = threads.insert(std::make_pair(change->id, std::vector<std::string>())).first;
+
+            std::string queryString("thread:" + change->id);
+            QueryPointer query(notmuch_query_create(database, queryString.c_str()));
+
+            notmuch_messages_t * threadMessages;
+            for (threadMessages = notmuch_query_search_messages(query.get());
+                notmuch_messages_valid(threadMessages);
+                notmuch_messages_move_to_next(threadMessages))
+            {
+                notmuch_message_t * message = notmuch_messages_get(threadMessages);
+                thread->second.push_back(notmuch_message_get_message_id(message));
+                notmuch_message_destroy(message);
+            }
+
+            if (thread->second.empty() && missingThread.empty())
+                missingThread = change->id;
+        }
+
+        for (auto id = thread->second.begin(), e = thread->second.end(); id != e; ++id)
+            messages[*id].push_back(&*change);
+    }
+
+    /* Each message is only written out once, after all of its changes */
+    for (auto id = messages.begin(), e = messages.end(); id != e; ++id)
+    {
+        notmuch_message_t * found = NULL;
+        notmuch_database_find_message(database, id->first.c_str(), &found);
+        MessagePointer message(found);
+
+        if (!message)
+        {
+            if (missingMessage.empty())
+                missingMessage = id->first;
+
+            continue;
+        }
+
+        notmuch_message_freeze(message.get());
+
+        for (auto change = id->second.begin(), e = id->second.end(); change != e; ++change)
+        {
+            if ((*change)->add)
+                notmuch_message_add_tag(message.get(), (*change)->tag.c_str());
+            else
+                notmuch_message_remove_tag(message.get(), (*change)->tag.c_str());
+        }
+
+        notmuch_message_thaw(message.get());
+    }
+
+    status = notmuch_database_end_atomic(database);
+
+    if (status != NOTMUCH_STATUS_SUCCESS)
+        throw std::runtime_error("Couldn't write tags: " + std::string(notmuch_status_to_string(status)));
+
+    if (!missingThread.empty())
+        throw InvalidThreadException(missingThread);
+
+    if (!missingMessage.empty())
+        throw InvalidMessageException(missingMessage);
 }
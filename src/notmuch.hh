@@ -22,8 +22,10 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <stdexcept>
 #include <future>
+#include <memory>
 
 #include "thread.hh"
 
@@ -32,22 +34,116 @@
 
 namespace Notmuch
 {
+    struct QueryDeleter
+    {
+        void operator()(notmuch_query_t * query) const { notmuch_query_destroy(query); }
+    };
+
+    struct MessageDeleter
+    {
+        void operator()(notmuch_message_t * message) const { notmuch_message_destroy(message); }
+    };
+
+    /* Owning pointers, which destroy the object when they go */
+    typedef std::unique_ptr<notmuch_query_t, QueryDeleter> QueryPointer;
+    typedef std::unique_ptr<notmuch_message_t, MessageDeleter> MessagePointer;
+
     void initializeDatabase(const std::string & path);
-    notmuch_database_t * readonlyDatabase();
     void closeDatabase();
 
-    notmuch_database_t * openDatabase(notmuch_database_mode_t mode = NOTMUCH_DATABASE_MODE_READ_ONLY);
+    /**
+     * Checks out a read-only database handle from a pool shared between
+     * threads. A pooled handle is reused until the database has changed, or
+     * it has been kept long enough that another client may have changed it.
+     *
+     * The handle must be given back with releaseDatabase().
+     */
+    notmuch_database_t * readonlyDatabase();
+
+    void releaseDatabase(notmuch_database_t * database);
+
+    /**
+     * Opens the database for writing. Only the writer thread of the
+     * TagQueue does this, and closes it again with closeWritableDatabase()
+     * once it is done, so that other clients can write in between.
+     *
+     * \throw std::runtime_error if the database can't be opened, for
+     *     example because another client is writing to it.
+     */
+    notmuch_database_t * openWritableDatabase();
+
+    /**
+     * Closes a database opened with openWritableDatabase(), which commits
+     * the changes, so the read-only handles opened afterwards see them.
+     */
+    void closeWritableDatabase(notmuch_database_t * database);
 
-    unsigned countMessages(std::string query);
-    std::vector<Thread> & searchThreads(std::string query);
+    /**
+     * Returns the revision of the given database, and optionally its UUID,
+     * which changes when revision numbers are no longer comparable.
+     *
+     * Returns 0 if libnotmuch does not track revisions.
+     */
+    unsigned long revision(notmuch_database_t * database, std::string * uuid = NULL);
 
-    notmuch_thread_t * thread(std::string id, notmuch_query_t ** queryp);
-    Thread & getThread(std::string id);
+    unsigned countMessages(std::string query, notmuch_database_t * database = NULL);
 
-    notmuch_message_t * message(std::string id);
-    Message & getMessage(std::string id);
+    /**
+     * Looks up the thread with the given ID. It stays valid as long as
+     * query, which receives the query it was found with.
+     */
+    notmuch_thread_t * thread(std::string id, QueryPointer & query,
+        notmuch_database_t * database);
+    Thread getThread(std::string id, notmuch_database_t * database);
+
+    MessagePointer message(std::string id, notmuch_database_t * database);
 
     GKeyFile * config();
+
+    /**
+     * Collects tag changes for any number of messages, and applies them to
+     * a writable database in a single atomic section, so it only needs to be
+     * committed once.
+     */
+    class TagTransaction
+    {
+        public:
+            void changeMessageTag(const std::string & messageId,
+                const std::string & tag, bool add);
+
+            /**
+             * Queues the change for each message of the thread.
+             */
+            void changeThreadTag(const std::string & threadId,
+                const std::string & tag, bool add);
+
+            bool empty() const { return _changes.empty(); }
+
+            /**
+             * Applies the queued changes to a database opened with
+             * openWritableDatabase(), and clears them. Each message receives
+             * its changes in the order they were queued, whether they were
+             * made to the message or to its thread.
+             *
+             * Changes to messages which can be found are applied even if
+             * others can't, after which the first of those is reported with
+             * an InvalidMessageException or InvalidThreadException. If the
+             * changes can't be written, throws std::runtime_error.
+             */
+            void commit(notmuch_database_t * database);
+
+        private:
+            struct Change
+            {
+                bool thread;
+                std::string id;
+                std::string tag;
+                bool add;
+            };
+
+            /* The changes, in the order they were queued */
+            std::vector<Change> _changes;
+    };
 };
 
 #endif
@@ -25,23 +25,21 @@
 #include "reply_view.hh"
 #include "notmuch.hh"
 #include "util.hh"
+#include "message_cache.hh"
 #include "message_part_text_visitor.hh"
 
 ReplyView::ReplyView(const std::string & messageId, const View::Geometry & geometry)
     : EmailEditView(geometry)
 {
-    Message & message = Notmuch::getMessage(messageId);
+    auto parsedMessage = MessageCache::instance().get(MessageHandle(messageId).filename());
 
-    FILE * messageFile = fopen(message.filename.c_str(), "r");
-    GMimeStream * stream = g_mime_stream_file_new(messageFile);
-    GMimeParser * parser = g_mime_parser_new_with_stream(stream);
+    if (!parsedMessage || !parsedMessage->message)
+        throw InvalidMessageException(messageId);
 
-    GMimeMessage * originalMessage = g_mime_parser_construct_message(parser);
+    /* Owned by the parsed message */
+    GMimeMessage * originalMessage = parsedMessage->message;
     GMimeMessage * replyMessage = g_mime_message_new(true);
 
-    g_object_unref(parser);
-    g_object_unref(stream);
-
     /* Set subject */
     std::string replyPrefix("Re:");
     std::string subject(g_mime_message_get_subject(originalMessage));
@@ -84,7 +82,7 @@ ReplyView::ReplyView(const std::string & messageId, const View::Geometry & geome
 
     if (replyTo)
     {
-        InternetAddressList * toRecipients = internet_address_list_parse_string(replyTo);
+        auto toRecipients = autoUnref(internet_address_list_parse_string(replyTo));
         internet_address_list_append(g_mime_message_get_recipients(replyMessage,
             GMIME_RECIPIENT_TYPE_TO), toRecipients);
     }
@@ -132,14 +130,16 @@ ReplyView::ReplyView(const std::string & messageId, const View::Geometry & geome
     /* Create a internet address for the user */
     InternetAddress * userAddress = internet_address_mailbox_new(_identity->name.c_str(),
         _identity->email.c_str());
-    g_mime_message_set_sender(replyMessage, internet_address_to_string(userAddress, true));
+    g_mime_message_set_sender(replyMessage,
+        takeString(internet_address_to_string(userAddress, true)).c_str());
     g_object_unref(userAddress);
 
     /* Set content */
     std::ostringstream messageContentStream;
-    messageContentStream << "On " << g_mime_message_get_date_as_string(originalMessage) << ", ";
+    messageContentStream << "On " << takeString(g_mime_message_get_date_as_string(originalMessage)) << ", ";
     messageContentStream << g_mime_message_get_sender(originalMessage) << " wrote:" << std::endl << "> ";
 
+    /* Owned by the message */
     GMimeObject * part = g_mime_message_get_mime_part(originalMessage);
 
     std::vector<std::shared_ptr<MessagePart>> parts;
@@ -151,8 +151,6 @@ ReplyView::ReplyView(const std::string & messageId, const View::Geometry & geome
     for (auto messagePart = parts.begin(), e = parts.end(); messagePart != e; ++messagePart)
         (*messagePart)->accept(visitor);
 
-    g_object_unref(part);
-
     /* Read user's signature */
     if (!_identity->signaturePath.empty())
     {
@@ -18,19 +18,31 @@
  */
 
 #include <sstream>
+#include <functional>
 
 #include "search_list_view.hh"
 #include "view_manager.hh"
 #include "search_view.hh"
 #include "ncurses.hh"
 #include "ner_config.hh"
+#include "notmuch.hh"
 
 const int searchNameWidth = 15;
 const int searchTermsWidth = 30;
 
+/* Without database revisions, counts are only refreshed after this long */
+const std::chrono::seconds maxCountAge(60);
+
+SearchListView::Count::Count()
+    : value(0), known(false), revision(0), pending(false)
+{
+}
+
 SearchListView::SearchListView(const View::Geometry & geometry)
     : LineBrowserView(geometry),
-        _searches(NerConfig::instance().searches())
+        _searches(NerConfig::instance().searches()),
+        _counts(_searches.size()),
+        _counting(false)
 {
     /* Key Sequences */
     addHandledSequence("\n", std::bind(&SearchListView::openSelectedSearch, this));
@@ -38,10 +50,17 @@ SearchListView::SearchListView(const View::Geometry & geometry)
 
 SearchListView::~SearchListView()
 {
+    if (_countThread.joinable())
+    {
+        _counting = false;
+        _countThread.join();
+    }
 }
 
 void SearchListView::update()
 {
+    startCounting();
+
     werase(_window);
 
     if (_offset > _searches.size())
@@ -82,7 +101,16 @@ void SearchListView::update()
 
             /* Number of Results */
             std::ostringstream results;
-            results << Notmuch::countMessages(search->query) << " results";
+
+            {
+                std::lock_guard<std::mutex> lock(_countsMutex);
+                const Count & count = _counts[search - _searches.begin()];
+
+                if (count.known)
+                    results << count.value << " results";
+                else
+                    results << "...";
+            }
 
             NCurses::addPlainString(_window, results.str(), attributes,
                 ColorID::SearchListViewResults);
@@ -109,11 +137,86 @@ std::vector<std::string> SearchListView::status() const
     return std::vector<std::string>{ searchPosition.str() };
 }
 
+bool SearchListView::busy() const
+{
+    return _counting;
+}
+
 int SearchListView::lineCount() const
 {
     return _searches.size();
 }
 
+void SearchListView::startCounting()
+{
+    if (_counting)
+        return;
+
+    if (_countThread.joinable())
+        _countThread.join();
+
+    notmuch_database_t * database = Notmuch::readonlyDatabase();
+    unsigned long revision = Notmuch::revision(database);
+
+    auto now = std::chrono::steady_clock::now();
+    bool stale = false;
+
+    {
+        std::lock_guard<std::mutex> lock(_countsMutex);
+
+        for (auto count = _counts.begin(), e = _counts.end(); count != e; ++count)
+        {
+            if (!count->known || count->revision != revision ||
+                (revision == 0 && now - count->time >= maxCountAge))
+            {
+                count->pending = true;
+                stale = true;
+            }
+        }
+    }
+
+    if (!stale)
+    {
+        Notmuch::releaseDatabase(database);
+        return;
+    }
+
+    _counting = true;
+    _countThread = std::thread(std::bind(&SearchListView::countSearches, this,
+        database));
+}
+
+void SearchListView::countSearches(notmuch_database_t * database)
+{
+    /* Stamp the counts with what this handle saw */
+    unsigned long revision = Notmuch::revision(database);
+
+    for (std::size_t index = 0; index < _searches.size() && _counting; ++index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_countsMutex);
+
+            if (!_counts[index].pending)
+                continue;
+        }
+
+        unsigned value = Notmuch::countMessages(_searches[index].query, database);
+
+        std::lock_guard<std::mutex> lock(_countsMutex);
+        Count & count = _counts[index];
+
+        count.value = value;
+        count.known = true;
+        count.revision = revision;
+        count.time = std::chrono::steady_clock::now();
+        count.pending = false;
+    }
+
+    Notmuch::releaseDatabase(database);
+
+    _counting = false;
+}
+
 void SearchListView::openSelectedSearch()
 {
     ViewManager::instance().addView(std::make_shared<SearchView>(
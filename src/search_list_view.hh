@@ -21,9 +21,15 @@
 #define NER_SEARCH_LIST_VIEW_H 1
 
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 
 #include "line_browser_view.hh"
 
+#include <notmuch.h>
+
 struct Search
 {
     std::string name;
@@ -37,6 +43,7 @@ class SearchListView : public LineBrowserView
         virtual ~SearchListView();
 
         virtual void update();
+        virtual bool busy() const;
         virtual std::string name() const { return "search-list-view"; }
         virtual std::vector<std::string> status() const;
 
@@ -46,7 +53,39 @@ class SearchListView : public LineBrowserView
         virtual int lineCount() const;
 
     private:
+        struct Count
+        {
+            Count();
+
+            unsigned value;
+            bool known;
+
+            /* The database revision and time the value was counted at */
+            unsigned long revision;
+            std::chrono::steady_clock::time_point time;
+
+            bool pending;
+        };
+
+        /**
+         * Starts counting the searches whose counts are out of date in the
+         * background, unless a count is already running.
+         */
+        void startCounting();
+
+        /**
+         * Counts the pending searches, and releases database when done. This
+         * runs in the counting thread.
+         */
+        void countSearches(notmuch_database_t * database);
+
         std::vector<Search> _searches;
+
+        std::vector<Count> _counts;
+        std::mutex _countsMutex;
+
+        std::thread _countThread;
+        std::atomic<bool> _counting;
 };
 
 #endif
@@ -22,7 +22,9 @@
 #include <algorithm>
 #include <chrono>
 #include <iterator>
-#include <sched.h>
+#include <set>
+#include <map>
+#include <cstdio>
 
 #include "search_view.hh"
 #include "thread_message_view.hh"
@@ -34,19 +36,54 @@
 #include "status_bar.hh"
 #include "line_editor.hh"
 #include "ner_config.hh"
+#include "tag_queue.hh"
 
 const int newestDateWidth = 13;
 const int messageCountWidth = 8;
 const int authorsWidth = 20;
 
-const auto conditionWaitTime = std::chrono::milliseconds(50);
+/* Above this many changed threads, a refresh re-runs the whole search */
+const std::size_t maxChangedThreads = 500;
+
+/* The collector hands over a batch once it has this many threads, or has been
+ * collecting it for this long, whichever comes first */
+const int maxBatchSize = 256;
+const std::chrono::milliseconds maxBatchDelay(50);
+
+/* The number of batches which can be waiting for the UI thread. When the queue
+ * is full, the collector keeps growing its current batch instead. */
+const std::size_t batchQueueSize = 64;
+
+/* The number of threads a shard looks up in the whole search at once, to find
+ * out which shard they belong to */
+const int resolveBatchSize = 64;
+
+/* The number of formatted rows kept, which should exceed the window height */
+const int formattedRowCount = 256;
 
 SearchView::SearchView(const std::string & search, const View::Geometry & geometry)
     : LineBrowserView(geometry),
-        _searchTerms(search)
+        _searchTerms(search),
+        _collecting(false),
+        _batches(batchQueueSize),
+        _collectionComplete(false),
+        _collectedRevision(0),
+        _refreshing(false),
+        _revision(0),
+        _formattedRows(formattedRowCount)
 {
-    _collecting = true;
-    _thread = std::thread(std::bind(&SearchView::collectThreads, this));
+    if (NerConfig::instance().virtualSearch())
+    {
+        _threadWindow.reset(new ThreadWindow(_searchTerms,
+            NerConfig::instance().searchPrefetch()));
+        _threadWindow->fetch(0, getmaxy(_window));
+    }
+    else
+    {
+        _collecting = true;
+        _thread = std::thread(std::bind(&SearchView::collectThreads, this,
+            Notmuch::readonlyDatabase()));
+    }
 
     std::map<std::string, std::string> _keymap = NerConfig::instance().getSearchKeyMap();
     std::map<std::string, std::string> _generalKeymap = NerConfig::instance().getGeneralKeyMap();
@@ -75,36 +112,54 @@ SearchView::SearchView(const std::string & search, const View::Geometry & geomet
     else
 	addHandledSequence("-", std::bind(&SearchView::removeTags, this));
 
-    std::unique_lock<std::mutex> lock(_mutex);
-    while (_threads.size() < getmaxy(_window) && _collecting)
-        _condition.wait_for(lock, conditionWaitTime);
+    if (_keymap.count("tagAllThreads") == 1)
+	addHandledSequence(_keymap.find("tagAllThreads")->second, std::bind(&SearchView::tagAllThreads, this));
+    else
+	addHandledSequence("*", std::bind(&SearchView::tagAllThreads, this));
 }
 
 SearchView::~SearchView()
 {
-    if (_thread.joinable())
-    {
-        _collecting = false;
-        _thread.join();
-    }
+    stopCollecting();
 }
 
 void SearchView::update()
 {
+    receiveThreads();
+
+    if (_tagger.active() && _tagger.apply())
+    {
+        std::ostringstream message;
+        message << "Tagged " << _tagger.applied() << " messages";
+        StatusBar::instance().displayMessage(message.str());
+
+        refreshThreads();
+    }
+
     werase(_window);
 
-    if (_offset > _threads.size())
+    if (_threadWindow)
+        _threadWindow->fetch(_offset, getmaxy(_window));
+
+    if (_offset > lineCount())
         return;
 
-    int row = 0;
+    ThreadStore & threads = this->threads();
+    TagID unreadTag = TagDictionary::instance().intern("unread");
+    time_t now = time(0);
 
-    for (auto thread = _threads.begin() + _offset;
-        thread != _threads.end() && row < getmaxy(_window);
-        ++thread, ++row)
+    for (int row = 0; row < getmaxy(_window) && row + _offset < lineCount(); ++row)
     {
-        bool selected = row + _offset == _selectedIndex;
-        bool unread = thread->tags.find("unread") != thread->tags.end();
-        bool completeMatch = thread->matchedMessages == thread->totalMessages;
+        int index = row + _offset;
+
+        if (_threadWindow && !_threadWindow->load(index))
+            break;
+
+        const FormattedRow & formatted = formatRow(threads, index, now);
+
+        bool selected = index == _selectedIndex;
+        bool unread = threads.tags(index).contains(unreadTag);
+        bool completeMatch = threads.matchedMessages(index) == threads.totalMessages(index);
 
         int x = 0;
 
@@ -123,19 +178,16 @@ void SearchView::update()
         try
         {
             /* Date */
-            NCurses::addPlainString(_window, relativeTime(thread->newestDate),
+            NCurses::addPlainString(_window, formatted.date,
                 attributes, ColorID::SearchViewDate, newestDateWidth - 1);
 
             NCurses::checkMove(_window, x += newestDateWidth);
 
             /* Message Count */
-            std::ostringstream messageCountStream;
-            messageCountStream << thread->matchedMessages << '/' << thread->totalMessages;
-
             x += NCurses::addChar(_window, '[', attributes);
             NCurses::checkMove(_window, x);
 
-            x += NCurses::addPlainString(_window, messageCountStream.str(),
+            x += NCurses::addPlainString(_window, formatted.messageCount,
                 attributes, completeMatch ? ColorID::SearchViewMessageCountComplete :
                                             ColorID::SearchViewMessageCountPartial,
                 messageCountWidth - 1);
@@ -146,28 +198,20 @@ void SearchView::update()
             NCurses::checkMove(_window, x = newestDateWidth + messageCountWidth);
 
             /* Authors */
-            NCurses::addUtf8String(_window, thread->authors.c_str(),
+            NCurses::addUtf8String(_window, threads.authors(index),
                 attributes, ColorID::SearchViewAuthors, authorsWidth - 1);
 
             NCurses::checkMove(_window, x += authorsWidth);
 
             /* Subject */
-            x += NCurses::addUtf8String(_window, thread->subject.c_str(),
+            x += NCurses::addUtf8String(_window, threads.subject(index),
                 attributes, ColorID::SearchViewSubject);
 
             NCurses::checkMove(_window, ++x);
 
             /* Tags */
-            std::ostringstream tagStream;
-            std::copy(thread->tags.begin(), thread->tags.end(),
-                std::ostream_iterator<std::string>(tagStream, " "));
-            std::string tags(tagStream.str());
-
-            if (tags.size() > 0)
-                /* Get rid of the trailing space */
-                tags.resize(tags.size() - 1);
-
-            x += NCurses::addPlainString(_window, tags, attributes, ColorID::SearchViewTags);
+            x += NCurses::addPlainString(_window, formatted.tagString,
+                attributes, ColorID::SearchViewTags);
 
             NCurses::checkMove(_window, x - 1);
         }
@@ -178,31 +222,52 @@ void SearchView::update()
     }
 }
 
+bool SearchView::busy() const
+{
+    return _collecting || _tagger.active();
+}
+
 std::vector<std::string> SearchView::status() const
 {
     std::ostringstream threadPosition;
 
-    if (_threads.size() > 0)
-        threadPosition << "thread " << (_selectedIndex + 1) << " of " << _threads.size();
+    if (lineCount() > 0)
+    {
+        threadPosition << "thread " << (_selectedIndex + 1) << " of " << lineCount();
+
+        if (_threadWindow && !_threadWindow->exhausted())
+            threadPosition << '+';
+    }
     else
         threadPosition << "no matching threads";
 
-    return std::vector<std::string>{
+    std::vector<std::string> status{
         "search-terms: \"" + _searchTerms + '"',
         threadPosition.str()
     };
+
+    if (_collecting)
+        status.push_back(_refreshing ? "refreshing" : "searching");
+
+    if (_tagger.active())
+    {
+        std::ostringstream tagging;
+        tagging << "tagging " << _tagger.applied() << " of " << _tagger.total();
+
+        status.push_back(tagging.str());
+    }
+
+    return status;
 }
 
 void SearchView::openSelectedThread()
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-
-    if (_selectedIndex < _threads.size())
+    if (loadThread(_selectedIndex))
     {
         try
         {
             ViewManager::instance().addView(std::make_shared<ThreadMessageView>(
-                _threads.at(_selectedIndex).id));
+                threads().id(_selectedIndex)));
         }
         catch (const InvalidThreadException & e)
         {
@@ -217,13 +282,11 @@ void SearchView::openSelectedThread()
 
 void SearchView::archiveSelectedThread()
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-
-    if (_selectedIndex < _threads.size())
+    if (loadThread(_selectedIndex))
     {
         try
         {
-            _threads.at(_selectedIndex).removeTag("inbox");
+            changeTags(_selectedIndex, { "inbox" }, false);
 
             next();
             update();
@@ -241,113 +304,646 @@ void SearchView::archiveSelectedThread()
 
 void SearchView::refreshThreads()
 {
-    /* If the thread is still going, stop it, and wait for it to return */
+    if (_threadWindow)
+    {
+        _threadWindow->reset();
+        _threadWindow->fetch(_offset, getmaxy(_window));
+
+        if (_selectedIndex >= lineCount())
+            _selectedIndex = std::max(lineCount() - 1, 0);
+
+        StatusBar::instance().update();
+        makeSelectionVisible();
+        return;
+    }
+
+    receiveThreads();
+
+    if (!_collecting && refreshChangedThreads())
+    {
+        StatusBar::instance().update();
+        makeSelectionVisible();
+        return;
+    }
+
+    /* If a collection is still going, stop it, and wait for it to return */
+    stopCollecting();
+
+    /* Collect the threads in the background into a second store, keeping the
+     * current ones visible until it is complete. update() swaps them in. */
+    _refreshedThreads.clear();
+    _refreshing = !_threads.empty();
+
+    if (!_refreshing)
+        _revision = 0;
+
+    _collecting = true;
+    _thread = std::thread(std::bind(&SearchView::collectThreads, this,
+        Notmuch::readonlyDatabase()));
+
+    StatusBar::instance().update();
+}
+
+void SearchView::receiveThreads()
+{
+    /* Check this before draining the queue, so we don't miss the batches
+     * handed over just before the collector finished */
+    bool collecting = _collecting;
+
+    ThreadStore & threads = _refreshing ? _refreshedThreads : _threads;
+    std::unique_ptr<ThreadStore> batch;
+
+    while (_batches.pop(batch))
+    {
+        for (int index = 0; index < batch->end(); ++index)
+            threads.append(*batch, index);
+    }
+
+    if (collecting || !_thread.joinable())
+        return;
+
+    _thread.join();
+
+    if (_refreshing)
+    {
+        /* Only a complete list can be swapped in */
+        if (_collectionComplete)
+            finishRefresh();
+        else
+        {
+            _refreshedThreads.clear();
+            _refreshing = false;
+        }
+    }
+    else
+    {
+        /* Only a complete list can be refreshed incrementally */
+        _revision = _collectionComplete ? _collectedRevision : 0;
+        _databaseUuid = _collectedDatabaseUuid;
+    }
+}
+
+void SearchView::finishRefresh()
+{
+    std::string selectedId;
+
+    if (_selectedIndex < _threads.end())
+        selectedId = _threads.id(_selectedIndex);
+
+    _threads.swap(_refreshedThreads);
+    _refreshedThreads.clear();
+
+    _revision = _collectedRevision;
+    _databaseUuid = _collectedDatabaseUuid;
+
+    _refreshing = false;
+
+    /* Keep the selection on the same thread if it is still there */
+    int index = 0;
+
+    for (; index < _threads.end(); ++index)
+    {
+        if (_threads.id(index) == selectedId)
+            break;
+    }
+
+    if (index < _threads.end())
+        _selectedIndex = index;
+    else if (_selectedIndex >= _threads.end())
+        _selectedIndex = std::max(_threads.end() - 1, 0);
+
+    /* Pick up the changes made while we were collecting */
+    refreshChangedThreads();
+
+    makeSelectionVisible();
+}
+
+void SearchView::stopCollecting()
+{
     if (_thread.joinable())
     {
         _collecting = false;
         _thread.join();
     }
 
-    bool empty = _threads.empty();
+    /* Drop whatever the collector handed over before it stopped */
+    std::unique_ptr<ThreadStore> batch;
+
+    while (_batches.pop(batch))
+        ;
+
+    _refreshedThreads.clear();
+    _refreshing = false;
+}
+
+int SearchView::lineCount() const
+{
+    if (_threadWindow)
+        return _threadWindow->size();
+
+    return _threads.end();
+}
+
+ThreadStore & SearchView::threads()
+{
+    if (_threadWindow)
+        return _threadWindow->threads();
+
+    return _threads;
+}
+
+bool SearchView::loadThread(int index)
+{
+    if (_threadWindow)
+        return _threadWindow->load(index);
+
+    return index < _threads.end();
+}
+
+void SearchView::changeTags(int index, const std::vector<std::string> & tags, bool add)
+{
+    for (auto tag = tags.begin(), e = tags.end(); tag != e; ++tag)
+        TagQueue::instance().changeThreadTag(threads().id(index), *tag, add);
+
+    TagDictionary & dictionary = TagDictionary::instance();
+
+    for (auto tag = tags.begin(), e = tags.end(); tag != e; ++tag)
+    {
+        if (tag->empty())
+            continue;
+
+        if (add)
+            threads().tags(index).insert(dictionary.intern(*tag));
+        else
+            threads().tags(index).erase(dictionary.intern(*tag));
+    }
+}
+
+SearchView::FormattedRow::FormattedRow()
+    : newestDate(0), matchedMessages(0), totalMessages(0), expires(0)
+{
+}
+
+const SearchView::FormattedRow & SearchView::formatRow(const ThreadStore & threads,
+    int index, time_t now)
+{
+    FormattedRow & row = _formattedRows[index % _formattedRows.size()];
+
+    if (now < row.expires && row.newestDate == threads.newestDate(index) &&
+        row.matchedMessages == threads.matchedMessages(index) &&
+        row.totalMessages == threads.totalMessages(index) &&
+        row.tags == threads.tags(index))
+    {
+        return row;
+    }
+
+    row.newestDate = threads.newestDate(index);
+    row.matchedMessages = threads.matchedMessages(index);
+    row.totalMessages = threads.totalMessages(index);
+    row.tags = threads.tags(index);
+
+    row.date = relativeTime(row.newestDate, &row.expires);
+
+    char messageCount[2 * 11 + 2];
+    snprintf(messageCount, sizeof(messageCount), "%u/%u",
+        row.matchedMessages, row.totalMessages);
+    row.messageCount = messageCount;
+
+    row.tagString = row.tags.toString();
+
+    return row;
+}
+
+bool SearchView::refreshChangedThreads()
+{
+    notmuch_sort_t sortMode = NerConfig::instance().sortMode();
+
+    /* We can only place changed threads for date orderings */
+    if (_revision == 0 || (sortMode != NOTMUCH_SORT_NEWEST_FIRST &&
+        sortMode != NOTMUCH_SORT_OLDEST_FIRST))
+    {
+        return false;
+    }
+
+    notmuch_database_t * database = Notmuch::readonlyDatabase();
+    auto releaseDatabase = onScopeEnd([database] { Notmuch::releaseDatabase(database); });
+
+    std::string uuid;
+    unsigned long revision = Notmuch::revision(database, &uuid);
+
+    if (uuid != _databaseUuid)
+        return false;
+
+    if (revision == _revision)
+        return true;
+
+    /* Find the threads containing messages changed since the last refresh.
+     * Walk the threads rather than the messages, so the walk stops at the
+     * cutoff rather than going through every changed message first. */
+    std::set<std::string> changedThreads;
+
+    std::ostringstream lastmod;
+    lastmod << "lastmod:" << (_revision + 1) << ".." << revision;
+
+    Notmuch::QueryPointer query(notmuch_query_create(database, lastmod.str().c_str()));
+    notmuch_query_set_sort(query.get(), NOTMUCH_SORT_UNSORTED);
+
+    notmuch_threads_t * changedIterator;
+
+    for (changedIterator = notmuch_query_search_threads(query.get());
+        notmuch_threads_valid(changedIterator) && changedThreads.size() <= maxChangedThreads;
+        notmuch_threads_move_to_next(changedIterator))
+    {
+        notmuch_thread_t * thread = notmuch_threads_get(changedIterator);
+        changedThreads.insert(notmuch_thread_get_thread_id(thread));
+        notmuch_thread_destroy(thread);
+    }
+
+    query.reset();
+
+    if (changedThreads.size() > maxChangedThreads)
+        return false;
+
+    if (changedThreads.empty())
+    {
+        _revision = revision;
+        return true;
+    }
+
+    /* Fetch the changed threads which still match the search */
+    std::string terms("(" + _searchTerms + ") and (");
+
+    for (auto id = changedThreads.begin(), e = changedThreads.end(); id != e; ++id)
+    {
+        if (id != changedThreads.begin())
+            terms.append(" or ");
+
+        terms.append("thread:" + *id);
+    }
+
+    terms.push_back(')');
+
+    ThreadStore changed;
+
+    query.reset(notmuch_query_create(database, terms.c_str()));
+    notmuch_query_set_sort(query.get(), sortMode);
+
+    notmuch_threads_t * threadIterator;
+    for (threadIterator = notmuch_query_search_threads(query.get());
+        notmuch_threads_valid(threadIterator);
+        notmuch_threads_move_to_next(threadIterator))
+    {
+        notmuch_thread_t * thread = notmuch_threads_get(threadIterator);
+        changed.append(thread);
+        notmuch_thread_destroy(thread);
+    }
+
+    query.reset();
+
+    /* Merge them with the unchanged threads, which are still in order */
+    auto before = [sortMode] (const ThreadStore & a, int i, const ThreadStore & b, int j)
+    {
+        if (sortMode == NOTMUCH_SORT_NEWEST_FIRST)
+            return a.newestDate(i) > b.newestDate(j);
+        else
+            return a.oldestDate(i) < b.oldestDate(j);
+    };
+
     std::string selectedId;
+    int selectedIndex = -1;
 
-    if (!empty)
-        selectedId = (*(_threads.begin() + _selectedIndex)).id;
+    if (_selectedIndex < _threads.end())
+        selectedId = _threads.id(_selectedIndex);
 
-    _threads.clear();
+    ThreadStore merged;
+    int changedIndex = 0;
 
-    /* Start collecting threads in the background */
-    _collecting = true;
-    _thread = std::thread(std::bind(&SearchView::collectThreads, this));
+    auto append = [&] (const ThreadStore & store, int index)
+    {
+        merged.append(store, index);
 
-    /* Locate the previously selected thread ID */
-    bool found = false;
-    std::unique_lock<std::mutex> lock(_mutex);
+        if (selectedIndex == -1 && selectedId == store.id(index))
+            selectedIndex = merged.end() - 1;
+    };
 
-    if (empty)
-        found = true;
-    else
+    for (int index = 0; index < _threads.end(); ++index)
     {
-        int index = 0;
+        if (changedThreads.count(_threads.id(index)) == 1)
+            continue;
 
-        while (!found && _collecting)
+        for (; changedIndex < changed.end() &&
+            before(changed, changedIndex, _threads, index); ++changedIndex)
         {
-            for (; index < _threads.size(); ++index)
-            {
-                /* Stop if we found the thread ID */
-                if (_threads.at(index).id == selectedId)
-                {
-                    found = true;
-                    _selectedIndex = index;
-                    break;
-                }
-            }
-
-            _condition.wait_for(lock, conditionWaitTime);
+            append(changed, changedIndex);
         }
+
+        append(_threads, index);
     }
 
-    /* Wait until we have enough threads to fill the screen */
-    while (_threads.size() - _offset < getmaxy(_window) && _collecting)
-        _condition.wait_for(lock, conditionWaitTime);
+    for (; changedIndex < changed.end(); ++changedIndex)
+        append(changed, changedIndex);
+
+    _threads.swap(merged);
+    _revision = revision;
+
+    /* Keep the selection on the same thread if it is still there */
+    if (selectedIndex != -1)
+        _selectedIndex = selectedIndex;
+    else if (_selectedIndex >= _threads.end())
+        _selectedIndex = std::max(_threads.end() - 1, 0);
+
+    return true;
+}
+
+SearchView::Shard::Shard(const std::string & terms_, time_t from_, time_t to_)
+    : terms(terms_), from(from_), to(to_), batches(batchQueueSize),
+        done(false), complete(false), revision(0)
+{
+}
 
-    /* If we didn't find it, make sure the selected index is valid */
-    if (!found)
+void SearchView::Shard::signal()
+{
+    /* Take the lock, so the signal can't slip in between the other thread
+     * checking the queue and starting to wait */
     {
-        if (_threads.size() <= _selectedIndex)
-            _selectedIndex = _threads.size() - 1;
+        std::lock_guard<std::mutex> lock(mutex);
     }
 
-    StatusBar::instance().update();
-    makeSelectionVisible();
+    ready.notify_one();
 }
 
-int SearchView::lineCount() const
+void SearchView::collectThreads(notmuch_database_t * database)
 {
-    return _threads.size();
+    notmuch_sort_t sortMode = NerConfig::instance().sortMode();
+    int shards = NerConfig::instance().searchShards();
+
+    /* Only date orderings can be split into date ranges */
+    if (shards > 1 && (sortMode == NOTMUCH_SORT_NEWEST_FIRST ||
+        sortMode == NOTMUCH_SORT_OLDEST_FIRST))
+    {
+        collectShards(database, shards);
+    }
+    else
+    {
+        _collectedRevision = Notmuch::revision(database, &_collectedDatabaseUuid);
+        _collectionComplete = walkThreads(database, _searchTerms, _batches, NULL);
+
+        Notmuch::releaseDatabase(database);
+    }
+
+    _collecting = false;
 }
 
-void SearchView::collectThreads()
+void SearchView::collectShards(notmuch_database_t * database, int count)
 {
-    std::unique_lock<std::mutex> lock(_mutex);
-    lock.unlock();
+    notmuch_sort_t sortMode = NerConfig::instance().sortMode();
+
+    _collectedRevision = Notmuch::revision(database, &_collectedDatabaseUuid);
+
+    /* Find the dates of the oldest and newest matching messages */
+    time_t dates[2];
+    int found = 0;
+
+    for (notmuch_sort_t sort : { NOTMUCH_SORT_OLDEST_FIRST, NOTMUCH_SORT_NEWEST_FIRST })
+    {
+        Notmuch::QueryPointer query(notmuch_query_create(database, _searchTerms.c_str()));
+        notmuch_query_set_sort(query.get(), sort);
+
+        notmuch_messages_t * messages = notmuch_query_search_messages(query.get());
+
+        if (notmuch_messages_valid(messages))
+        {
+            notmuch_message_t * message = notmuch_messages_get(messages);
+            dates[found++] = notmuch_message_get_date(message);
+            notmuch_message_destroy(message);
+        }
+    }
+
+    Notmuch::releaseDatabase(database);
+
+    if (found < 2)
+    {
+        _collectionComplete = true;
+        return;
+    }
+
+    /* Split the range into equal spans, in the order of the results */
+    std::vector<std::unique_ptr<Shard>> shards;
+    time_t span = (dates[1] - dates[0]) / count + 1;
+
+    for (time_t from = dates[0]; from <= dates[1]; from += span)
+    {
+        time_t to = std::min<time_t>(from + span - 1, dates[1]);
+
+        std::ostringstream terms;
+        terms << '(' << _searchTerms << ") and date:@" << from << "..@" << to;
+
+        shards.push_back(std::unique_ptr<Shard>(new Shard(terms.str(), from, to)));
+    }
+
+    if (sortMode == NOTMUCH_SORT_NEWEST_FIRST)
+        std::reverse(shards.begin(), shards.end());
+
+    for (auto shard = shards.begin(), e = shards.end(); shard != e; ++shard)
+    {
+        (*shard)->thread = std::thread(std::bind(&SearchView::collectShard,
+            this, std::ref(**shard)));
+    }
+
+    /* Each thread is kept by only one shard, and the date ranges don't
+     * overlap, so merging the shards comes down to passing them on one after
+     * the other. This way, the first screen shows up as soon as the first
+     * shard has it, while the others keep collecting. */
+    _collectionComplete = true;
+
+    for (auto shard = shards.begin(), e = shards.end(); shard != e; ++shard)
+    {
+        Shard & current = **shard;
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(current.mutex);
+                current.ready.wait(lock, [&current] {
+                    return current.done || !current.batches.empty();
+                });
+            }
+
+            bool done = current.done;
+            std::unique_ptr<ThreadStore> batch;
+
+            /* Once collecting stops, the batches are just dropped */
+            while (current.batches.pop(batch))
+            {
+                while (_collecting && !_batches.push(batch))
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
 
+            if (done)
+                break;
+        }
+
+        (*shard)->thread.join();
+        _collectionComplete = _collectionComplete && _collecting && (*shard)->complete;
+
+        /* Each shard has a handle of its own, which may be older than ours */
+        _collectedRevision = std::min(_collectedRevision, (*shard)->revision);
+    }
+}
+
+void SearchView::collectShard(Shard & shard)
+{
     notmuch_database_t * database = Notmuch::readonlyDatabase();
-    notmuch_query_t * query = notmuch_query_create(database, _searchTerms.c_str());
-    notmuch_query_set_sort(query, NerConfig::instance().sortMode());
+
+    shard.revision = Notmuch::revision(database);
+    shard.complete = walkThreads(database, shard.terms, shard.batches, &shard);
+
+    Notmuch::releaseDatabase(database);
+
+    shard.done = true;
+    shard.signal();
+}
+
+bool SearchView::walkThreads(notmuch_database_t * database, const std::string & terms,
+    SpscQueue<std::unique_ptr<ThreadStore>> & batches, Shard * shard)
+{
+    notmuch_sort_t sortMode = NerConfig::instance().sortMode();
+    Notmuch::QueryPointer query(notmuch_query_create(database, terms.c_str()));
+    notmuch_query_set_sort(query.get(), sortMode);
     notmuch_threads_t * threadIterator;
 
-    for (threadIterator = notmuch_query_search_threads(query);
+    std::unique_ptr<ThreadStore> batch(new ThreadStore);
+    auto batchStart = std::chrono::steady_clock::now();
+
+    /* The threads held back until the ambiguous ones among them are
+     * resolved, to keep them in order */
+    std::vector<notmuch_thread_t *> pending;
+    int ambiguous = 0;
+
+    for (threadIterator = notmuch_query_search_threads(query.get());
         notmuch_threads_valid(threadIterator) && _collecting;
         notmuch_threads_move_to_next(threadIterator))
     {
-        lock.lock();
-
         notmuch_thread_t * thread = notmuch_threads_get(threadIterator);
-        _threads.push_back(Thread(thread));
 
-        _condition.notify_one();
+        /* A thread with messages outside of the shard's date range may have
+         * matches there too, and belong to another shard */
+        bool partial = shard && notmuch_thread_get_matched_messages(thread) <
+            notmuch_thread_get_total_messages(thread);
+
+        if (partial || !pending.empty())
+        {
+            pending.push_back(thread);
+
+            if (partial && ++ambiguous == resolveBatchSize)
+            {
+                resolveThreads(database, *shard, pending, *batch);
+                ambiguous = 0;
+            }
+        }
+        else
+        {
+            batch->append(thread);
+            notmuch_thread_destroy(thread);
+        }
+
+        auto now = std::chrono::steady_clock::now();
 
-        lock.unlock();
+        if ((batch->end() >= maxBatchSize || now - batchStart >= maxBatchDelay)
+            && !batch->empty() && batches.push(batch))
+        {
+            batch.reset(new ThreadStore);
+            batchStart = now;
 
-        sched_yield();
+            if (shard)
+                shard->signal();
+        }
     }
 
-    _collecting = false;
-    notmuch_query_destroy(query);
-    notmuch_database_close(database);
+    if (!pending.empty())
+        resolveThreads(database, *shard, pending, *batch);
+
+    bool complete = !notmuch_threads_valid(threadIterator);
+
+    query.reset();
 
-    /* For cases when there are no matching threads */
-    _condition.notify_one();
+    /* The other end keeps draining the queue until we are done */
+    while (!batch->empty() && _collecting && !batches.push(batch))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    return complete;
 }
 
-void SearchView::addTags()
+void SearchView::resolveThreads(notmuch_database_t * database, const Shard & shard,
+    std::vector<notmuch_thread_t *> & pending, ThreadStore & batch)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    notmuch_sort_t sortMode = NerConfig::instance().sortMode();
+
+    /* Look up the ambiguous threads in the whole search at once, to get all
+     * of their matches */
+    std::string terms("(" + _searchTerms + ") and (");
+    bool first = true;
 
-    if (_selectedIndex < _threads.size())
+    for (auto thread = pending.begin(), e = pending.end(); thread != e; ++thread)
     {
-        Thread & thread = _threads.at(_selectedIndex);
+        if (notmuch_thread_get_matched_messages(*thread) <
+            notmuch_thread_get_total_messages(*thread))
+        {
+            terms.append(first ? "thread:" : " or thread:");
+            terms.append(notmuch_thread_get_thread_id(*thread));
+            first = false;
+        }
+    }
+
+    terms.push_back(')');
+
+    Notmuch::QueryPointer query(notmuch_query_create(database, terms.c_str()));
+    std::map<std::string, notmuch_thread_t *> matches;
+
+    for (notmuch_threads_t * threads = notmuch_query_search_threads(query.get());
+        notmuch_threads_valid(threads); notmuch_threads_move_to_next(threads))
+    {
+        notmuch_thread_t * thread = notmuch_threads_get(threads);
+        matches[notmuch_thread_get_thread_id(thread)] = thread;
+    }
+
+    for (auto thread = pending.begin(), e = pending.end(); thread != e; ++thread)
+    {
+        if (notmuch_thread_get_matched_messages(*thread) ==
+            notmuch_thread_get_total_messages(*thread))
+        {
+            batch.append(*thread);
+        }
+        else
+        {
+            auto match = matches.find(notmuch_thread_get_thread_id(*thread));
+
+            if (match != matches.end())
+            {
+                /* Keep the thread only in the shard it is sorted into */
+                time_t date = sortMode == NOTMUCH_SORT_NEWEST_FIRST ?
+                    notmuch_thread_get_newest_date(match->second) :
+                    notmuch_thread_get_oldest_date(match->second);
+
+                if (date >= shard.from && date <= shard.to)
+                    batch.append(match->second);
+            }
+        }
+
+        notmuch_thread_destroy(*thread);
+    }
+
+    for (auto match = matches.begin(), e = matches.end(); match != e; ++match)
+        notmuch_thread_destroy(match->second);
+
+    pending.clear();
+}
+
+void SearchView::addTags()
+{
+    if (loadThread(_selectedIndex))
+    {
+        int index = _selectedIndex;
 
         try
         {
@@ -356,11 +952,14 @@ void SearchView::addTags()
             if (!tags.empty()) {
                 std::stringstream ss(tags);
                 std::string s;
+                std::vector<std::string> tagList;
 
                 while (std::getline(ss, s, ' ')) {
-                    thread.addTag(s);
+                    tagList.push_back(s);
                 }
 
+                changeTags(index, tagList, true);
+
                 next();
                 update();
             }
@@ -373,11 +972,9 @@ void SearchView::addTags()
 
 void SearchView::removeTags()
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-
-    if (_selectedIndex < _threads.size())
+    if (loadThread(_selectedIndex))
     {
-        Thread & thread = _threads.at(_selectedIndex);
+        int index = _selectedIndex;
 
         try
         {
@@ -386,11 +983,14 @@ void SearchView::removeTags()
             if (!tags.empty()) {
                 std::stringstream ss(tags);
                 std::string s;
+                std::vector<std::string> tagList;
 
                 while (std::getline(ss, s, ' ')) {
-                    thread.removeTag(s);
+                    tagList.push_back(s);
                 }
 
+                changeTags(index, tagList, false);
+
                 next();
                 update();
             }
@@ -401,5 +1001,43 @@ void SearchView::removeTags()
     }
 }
 
-// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
+void SearchView::tagAllThreads()
+{
+    if (_tagger.active())
+    {
+        _tagger.cancel();
+
+        std::ostringstream message;
+        message << "Tagging cancelled after " << _tagger.applied() << " messages";
+        StatusBar::instance().displayMessage(message.str());
+
+        refreshThreads();
+        return;
+    }
 
+    try
+    {
+        std::string changes = StatusBar::instance().prompt("Tag all (+add -remove): ", "tags");
+
+        std::stringstream ss(changes);
+        std::string s;
+        std::vector<std::string> addTags, removeTags;
+
+        while (std::getline(ss, s, ' ')) {
+            if (s.size() > 1 && s[0] == '-')
+                removeTags.push_back(s.substr(1));
+            else if (s.size() > 1 && s[0] == '+')
+                addTags.push_back(s.substr(1));
+            else if (!s.empty())
+                addTags.push_back(s);
+        }
+
+        if (!addTags.empty() || !removeTags.empty())
+            _tagger.start(_searchTerms, addTags, removeTags);
+    }
+    catch (const AbortInputException&)
+    {
+    }
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
@@ -22,10 +22,17 @@
 
 #include <string>
 #include <thread>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include "line_browser_view.hh"
 #include "notmuch.hh"
-#include "thread.hh"
+#include "thread_store.hh"
+#include "thread_window.hh"
+#include "spsc_queue.hh"
+#include "bulk_tagger.hh"
 
 class SearchView : public LineBrowserView
 {
@@ -35,6 +42,7 @@ class SearchView : public LineBrowserView
         virtual ~SearchView();
 
         virtual void update();
+        virtual bool busy() const;
         virtual std::string name() const { return "search-view"; }
         virtual std::vector<std::string> status() const;
 
@@ -46,20 +54,162 @@ class SearchView : public LineBrowserView
         void addTags();
         void removeTags();
 
+        /**
+         * Prompts for tags to add and remove on every message matching the
+         * search, and changes them in the background. If that is already
+         * going on, cancels it instead.
+         */
+        void tagAllThreads();
+
     protected:
         virtual int lineCount() const;
 
     private:
-        void collectThreads();
+        /**
+         * One date range of a sharded search, collected by a thread of its
+         * own.
+         */
+        struct Shard
+        {
+            Shard(const std::string & terms, time_t from, time_t to);
+
+            /**
+             * Wakes up the thread passing the shards on.
+             */
+            void signal();
+
+            std::string terms;
+            time_t from;
+            time_t to;
+
+            std::thread thread;
+            SpscQueue<std::unique_ptr<ThreadStore>> batches;
+
+            /* Set once the last batch is in the queue */
+            std::atomic<bool> done;
+            bool complete;
+            unsigned long revision;
+
+            /* Signalled when a batch is pushed, or the shard is done */
+            std::mutex mutex;
+            std::condition_variable ready;
+        };
+
+        /**
+         * Runs in the collector thread, and releases database when done.
+         */
+        void collectThreads(notmuch_database_t * database);
+        void stopCollecting();
+
+        /**
+         * Collects the search split into count date ranges, each in a thread
+         * of its own, and passes the results on in order.
+         */
+        void collectShards(notmuch_database_t * database, int count);
+        void collectShard(Shard & shard);
+
+        /**
+         * Walks the threads matching terms, handing them to batches.
+         *
+         * \param shard If set, only the threads sorted into this shard are
+         *        kept.
+         *
+         * \return Whether every matching thread was walked.
+         */
+        bool walkThreads(notmuch_database_t * database, const std::string & terms,
+            SpscQueue<std::unique_ptr<ThreadStore>> & batches, Shard * shard);
+
+        /**
+         * Appends the pending threads walked by shard to batch, in order,
+         * keeping only those sorted into the shard, and destroys them.
+         */
+        void resolveThreads(notmuch_database_t * database, const Shard & shard,
+            std::vector<notmuch_thread_t *> & pending, ThreadStore & batch);
+
+        /**
+         * Moves the batches handed over by the collector into the list, and
+         * finishes up the collection once it is done.
+         */
+        void receiveThreads();
+
+        /**
+         * Swaps in the threads collected by a finished refresh.
+         */
+        void finishRefresh();
+
+        /**
+         * Updates only the threads which changed since the list was
+         * collected.
+         *
+         * \return Whether the list could be refreshed incrementally.
+         */
+        bool refreshChangedThreads();
+
+        /**
+         * The store holding the threads, which depends on whether the search
+         * is virtual.
+         */
+        ThreadStore & threads();
+        bool loadThread(int index);
+
+        /**
+         * Adds or removes tags on each message of the thread at index.
+         */
+        void changeTags(int index, const std::vector<std::string> & tags, bool add);
+
+        /**
+         * The formatted columns of a row. They only depend on the fields
+         * copied here, and on the time until the relative date rolls over.
+         */
+        struct FormattedRow
+        {
+            FormattedRow();
+
+            time_t newestDate;
+            uint32_t matchedMessages;
+            uint32_t totalMessages;
+            TagSet tags;
+
+            time_t expires;
+
+            std::string date;
+            std::string messageCount;
+            std::string tagString;
+        };
+
+        const FormattedRow & formatRow(const ThreadStore & threads, int index, time_t now);
 
         std::string _searchTerms;
 
         std::thread _thread;
-        std::mutex _mutex;
-        std::condition_variable _condition;
-        bool _collecting;
+        std::atomic<bool> _collecting;
+
+        /* Batches of threads from the collector, only touched by the UI
+         * thread on the other end */
+        SpscQueue<std::unique_ptr<ThreadStore>> _batches;
+
+        /* Set by the collector before it clears _collecting */
+        bool _collectionComplete;
+        unsigned long _collectedRevision;
+        std::string _collectedDatabaseUuid;
+
+        /* Whether batches go to _refreshedThreads rather than _threads */
+        bool _refreshing;
+
+        ThreadStore _threads;
+        ThreadStore _refreshedThreads;
+
+        /* The database revision _threads is up to date with, or 0 */
+        unsigned long _revision;
+        std::string _databaseUuid;
+
+        /* Only set when the search is virtual */
+        std::unique_ptr<ThreadWindow> _threadWindow;
+
+        /* Indexed by the row index modulo its size */
+        std::vector<FormattedRow> _formattedRows;
 
-        std::vector<Thread> _threads;
+        BulkTagger _tagger;
 };
 
 #endif
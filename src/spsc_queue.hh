@@ -0,0 +1,115 @@
+/* ner: src/spsc_queue.hh
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NER_SPSC_QUEUE_H
+#define NER_SPSC_QUEUE_H 1
+
+#include <vector>
+#include <atomic>
+#include <utility>
+
+/**
+ * A bounded, lock-free queue between exactly one producer thread and one
+ * consumer thread.
+ */
+template <class T>
+    class SpscQueue
+{
+    static const std::size_t cacheLineSize = 64;
+
+    public:
+        /**
+         * \param capacity The number of slots, rounded up to a power of two.
+         */
+        explicit SpscQueue(std::size_t capacity)
+            : _head(0), _tail(0)
+        {
+            std::size_t size = 1;
+
+            while (size < capacity)
+                size <<= 1;
+
+            _slots.resize(size);
+            _mask = size - 1;
+        }
+
+        /**
+         * Moves value into the queue. Only call this from the producer.
+         *
+         * \return false, leaving value untouched, if the queue is full.
+         */
+        bool push(T & value)
+        {
+            std::size_t tail = _tail.load(std::memory_order_relaxed);
+
+            if (tail - _head.load(std::memory_order_acquire) > _mask)
+                return false;
+
+            _slots[tail & _mask] = std::move(value);
+            _tail.store(tail + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        /**
+         * Moves the oldest value out of the queue. Only call this from the
+         * consumer.
+         *
+         * \return false if the queue is empty.
+         */
+        bool pop(T & value)
+        {
+            std::size_t head = _head.load(std::memory_order_relaxed);
+
+            if (head == _tail.load(std::memory_order_acquire))
+                return false;
+
+            value = std::move(_slots[head & _mask]);
+            _head.store(head + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        /**
+         * Whether the queue is empty. Only call this from the consumer.
+         */
+        bool empty() const
+        {
+            return _head.load(std::memory_order_relaxed) ==
+                _tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::vector<T> _slots;
+        std::size_t _mask;
+
+        /* Keep the indices on separate cache lines, since each is written by
+         * a different thread. They are padded apart rather than aligned, so
+         * queues can be allocated with plain new. */
+        char _headPadding[cacheLineSize];
+        std::atomic<std::size_t> _head;
+        char _tailPadding[cacheLineSize];
+        std::atomic<std::size_t> _tail;
+        char _endPadding[cacheLineSize];
+};
+
+#endif
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
+
@@ -0,0 +1,422 @@
+/* ner: src/tag_queue.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <iterator>
+#include <thread>
+#include <functional>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tag_queue.hh"
+#include "util.hh"
+
+const std::size_t maxFlushes = 16;
+
+const std::chrono::milliseconds initialRetryDelay(1000);
+const std::chrono::milliseconds maxRetryDelay(30000);
+
+TagQueue & TagQueue::instance()
+{
+    static TagQueue * queue = NULL;
+
+    if (!queue)
+        queue = new TagQueue();
+
+    return *queue;
+}
+
+TagQueue::TagQueue()
+    : _origin(NULL), _mixedOrigins(false), _writing(false), _failures(0),
+        _journal(-1), _retryDelay(initialRetryDelay)
+{
+    /* The writer lives until ner exits */
+    std::thread(std::bind(&TagQueue::write, this)).detach();
+}
+
+TagQueue::~TagQueue()
+{
+    if (_journal != -1)
+        close(_journal);
+}
+
+void TagQueue::openJournal(const std::string & path)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        /* Each line holds the change, whether it is to a thread or a message,
+         * the tag, and the ID, separated by tabs */
+        std::ifstream journal(path.c_str());
+        std::string line;
+
+        while (std::getline(journal, line))
+        {
+            std::size_t tagEnd = line.find('\t', 3);
+
+            if (line.size() < 3 || (line[0] != '+' && line[0] != '-') ||
+                (line[1] != 't' && line[1] != 'm') || line[2] != '\t' ||
+                tagEnd == std::string::npos)
+            {
+                continue;
+            }
+
+            insert(Target(line[1] == 't', line.substr(tagEnd + 1),
+                line.substr(3, tagEnd - 3)), line[0] == '+', NULL);
+        }
+
+        /* Open it before the writer can clear it */
+        _journal = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0600);
+    }
+
+    _wakeup.notify_one();
+}
+
+void TagQueue::changeMessageTag(const std::string & messageId, const std::string & tag,
+    bool add, const void * origin)
+{
+    queue(Target(false, messageId, tag), add, origin);
+}
+
+void TagQueue::changeThreadTag(const std::string & threadId, const std::string & tag,
+    bool add, const void * origin)
+{
+    queue(Target(true, threadId, tag), add, origin);
+}
+
+std::future<void> TagQueue::commit(Notmuch::TagTransaction transaction)
+{
+    std::future<void> result;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _jobs.push_back(Job{ std::move(transaction), std::promise<void>() });
+        result = _jobs.back().result.get_future();
+    }
+
+    _wakeup.notify_one();
+
+    return result;
+}
+
+bool TagQueue::pending()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return !_changes.empty() || !_jobs.empty() || _writing;
+}
+
+bool TagQueue::flush()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    unsigned failures = _failures;
+    _retryTime = std::chrono::steady_clock::time_point();
+
+    _wakeup.notify_one();
+    _written.wait(lock, [this, failures] {
+        return _failures != failures || (_changes.empty() && _jobs.empty() && !_writing);
+    });
+
+    return _changes.empty();
+}
+
+unsigned long TagQueue::follow(unsigned long revision, const void * origin)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for (auto flush = _flushes.begin(), e = _flushes.end(); flush != e; ++flush)
+    {
+        if (flush->from == revision && flush->origin == origin)
+            revision = flush->to;
+    }
+
+    return revision;
+}
+
+std::string TagQueue::takeError()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::string error;
+    error.swap(_error);
+
+    return error;
+}
+
+void TagQueue::queue(const Target & target, bool add, const void * origin)
+{
+    if (std::get<2>(target).empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        insert(target, add, origin);
+
+        /* A change which can't be journaled is still queued */
+        if (_journal != -1)
+            journal(std::prev(_changes.end()), _changes.end());
+    }
+
+    _wakeup.notify_one();
+}
+
+void TagQueue::insert(const Target & target, bool add, const void * origin)
+{
+    if (_changes.empty())
+        _origin = origin;
+    else if (origin != _origin)
+        _mixedOrigins = true;
+
+    /* Move a change to the same target to the end, so it is applied after
+     * the changes made since, to the thread or messages it overlaps */
+    auto indexed = _changeIndex.find(target);
+
+    if (indexed != _changeIndex.end())
+        _changes.erase(indexed->second);
+
+    _changes.push_back(std::make_pair(target, add));
+    _changeIndex[target] = std::prev(_changes.end());
+}
+
+void TagQueue::write()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        bool due = !_changes.empty() && std::chrono::steady_clock::now() >= _retryTime;
+
+        if (!due && _jobs.empty())
+        {
+            if (_changes.empty())
+                _wakeup.wait(lock);
+            else
+                _wakeup.wait_until(lock, _retryTime);
+
+            continue;
+        }
+
+        /* Take what there is to write, so more can be queued meanwhile */
+        ChangeList changes;
+        const void * origin = _origin;
+        bool mixedOrigins = _mixedOrigins;
+
+        if (due)
+        {
+            changes.swap(_changes);
+            _changeIndex.clear();
+            _origin = NULL;
+            _mixedOrigins = false;
+        }
+
+        std::deque<Job> jobs;
+        jobs.swap(_jobs);
+
+        _writing = true;
+
+        lock.unlock();
+
+        Notmuch::TagTransaction transaction;
+
+        for (auto change = changes.begin(), e = changes.end(); change != e; ++change)
+        {
+            const std::string & id = std::get<1>(change->first);
+            const std::string & tag = std::get<2>(change->first);
+
+            if (std::get<0>(change->first))
+                transaction.changeThreadTag(id, tag, change->second);
+            else
+                transaction.changeMessageTag(id, tag, change->second);
+        }
+
+        notmuch_database_t * database = NULL;
+        std::string error;
+        bool written = changes.empty();
+        unsigned long from = 0, to = 0;
+
+        try
+        {
+            database = Notmuch::openWritableDatabase();
+        }
+        catch (const std::runtime_error & e)
+        {
+            error = e.what();
+        }
+
+        if (database)
+        {
+            from = Notmuch::revision(database);
+
+            try
+            {
+                if (!changes.empty())
+                    transaction.commit(database);
+
+                written = true;
+            }
+            catch (const InvalidThreadException & e)
+            {
+                /* Whatever could be found was changed, and the rest never will be */
+                written = true;
+            }
+            catch (const InvalidMessageException & e)
+            {
+                written = true;
+            }
+            catch (const std::runtime_error & e)
+            {
+                error = e.what();
+            }
+
+            to = Notmuch::revision(database);
+
+            for (auto job = jobs.begin(), e = jobs.end(); job != e; ++job)
+            {
+                try
+                {
+                    job->transaction.commit(database);
+                    job->result.set_value();
+                }
+                catch (...)
+                {
+                    job->result.set_exception(std::current_exception());
+                }
+            }
+
+            Notmuch::closeWritableDatabase(database);
+        }
+        else
+        {
+            for (auto job = jobs.begin(), e = jobs.end(); job != e; ++job)
+                job->result.set_exception(std::make_exception_ptr(std::runtime_error(error)));
+        }
+
+        lock.lock();
+
+        _writing = false;
+
+        if (!written)
+        {
+            requeue(changes, origin, mixedOrigins);
+
+            _error = "Couldn't write tags, retrying: " + error;
+            _retryTime = std::chrono::steady_clock::now() + _retryDelay;
+            _retryDelay = std::min(_retryDelay * 2, maxRetryDelay);
+            ++_failures;
+        }
+        else if (!changes.empty())
+        {
+            if (!mixedOrigins)
+            {
+                _flushes.push_back({ from, to, origin });
+
+                if (_flushes.size() > maxFlushes)
+                    _flushes.pop_front();
+            }
+
+            _retryDelay = initialRetryDelay;
+
+            /* The database has committed the changes by now, so only those
+             * queued during the write are left for the journal. If clearing
+             * it fails, the next session writes the changes again. */
+            if (_journal != -1)
+            {
+                if (ftruncate(_journal, 0) != 0)
+                    reportJournalError("clear");
+                else
+                    journal(_changes.begin(), _changes.end());
+            }
+        }
+
+        _written.notify_all();
+    }
+}
+
+void TagQueue::requeue(ChangeList & changes, const void * origin, bool mixedOrigins)
+{
+    if (changes.empty())
+        return;
+
+    if (_changes.empty())
+    {
+        _origin = origin;
+        _mixedOrigins = mixedOrigins;
+    }
+    else if (mixedOrigins || origin != _origin)
+        _mixedOrigins = true;
+
+    for (auto change = changes.rbegin(), e = changes.rend(); change != e; ++change)
+    {
+        if (_changeIndex.count(change->first))
+            continue;
+
+        _changes.push_front(*change);
+        _changeIndex[change->first] = _changes.begin();
+    }
+}
+
+void TagQueue::journal(ChangeList::const_iterator begin, ChangeList::const_iterator end)
+{
+    std::string lines;
+
+    for (auto change = begin; change != end; ++change)
+    {
+        const Target & target = change->first;
+
+        lines += change->second ? '+' : '-';
+        lines += std::get<0>(target) ? 't' : 'm';
+        lines += '\t' + std::get<2>(target) + '\t' + std::get<1>(target) + '\n';
+    }
+
+    std::size_t written = 0;
+
+    while (written < lines.size())
+    {
+        ssize_t count = ::write(_journal, lines.data() + written, lines.size() - written);
+
+        if (count == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            reportJournalError("write to");
+            return;
+        }
+
+        written += count;
+    }
+
+    /* Make sure the changes survive a crash once they are queued */
+    if (fdatasync(_journal) != 0)
+        reportJournalError("sync");
+}
+
+void TagQueue::reportJournalError(const std::string & action)
+{
+    _error = "Couldn't " + action + " the tag journal: " + std::strerror(errno);
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
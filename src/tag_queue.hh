@@ -0,0 +1,188 @@
+/* ner: src/tag_queue.hh
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NER_TAG_QUEUE_H
+#define NER_TAG_QUEUE_H 1
+
+#include <string>
+#include <map>
+#include <list>
+#include <deque>
+#include <tuple>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+
+#include "notmuch.hh"
+
+/**
+ * Queues tag changes, and writes them to the database from a writer thread,
+ * so that neither handling a key nor checking out a database waits for the
+ * write.
+ *
+ * Changes are kept in the order they were made, with a later change of the
+ * same tag on the same thread or message replacing the earlier one, until
+ * the writer takes them. It opens the writable database for each write and
+ * closes it afterwards, which commits the changes and lets other clients
+ * write in between. If the database can't be written, the changes stay
+ * queued, and are tried again after a delay, growing with each failure.
+ *
+ * Changes are appended to a journal, and synced to disk, as they are queued,
+ * so that changes left unwritten by a session which ended early are replayed
+ * by the next one. The journal is cleared once they have been written.
+ *
+ * Views make the changes to the tags they show themselves, when queueing
+ * them.
+ */
+class TagQueue
+{
+    public:
+        static TagQueue & instance();
+
+        /**
+         * Opens the journal at path, and queues the changes left in it.
+         */
+        void openJournal(const std::string & path);
+
+        /**
+         * \param origin Identifies what made the change, for follow().
+         */
+        void changeMessageTag(const std::string & messageId, const std::string & tag,
+            bool add, const void * origin = NULL);
+
+        /**
+         * Queues the change for each message of the thread.
+         */
+        void changeThreadTag(const std::string & threadId, const std::string & tag,
+            bool add, const void * origin = NULL);
+
+        /**
+         * Has the writer commit transaction, which isn't journaled.
+         *
+         * \return A future which becomes ready once the transaction was
+         *     committed, or holds the exception it couldn't be committed with.
+         */
+        std::future<void> commit(Notmuch::TagTransaction transaction);
+
+        /**
+         * Whether there are changes the writer hasn't written yet.
+         */
+        bool pending();
+
+        /**
+         * Has the writer write the queued changes straight away, and waits
+         * until it has, or has failed to.
+         *
+         * \return Whether nothing is left queued.
+         */
+        bool flush();
+
+        /**
+         * Returns the revision of the database after the flushes which
+         * started at revision, and only held changes made by origin.
+         */
+        unsigned long follow(unsigned long revision, const void * origin);
+
+        /**
+         * Returns the last error the writer or the journal ran into since
+         * this was last called, or an empty string.
+         */
+        std::string takeError();
+
+    private:
+        TagQueue();
+        ~TagQueue();
+
+        /* Whether it is a thread, its ID, and the tag */
+        typedef std::tuple<bool, std::string, std::string> Target;
+
+        /* Whether each tag is to be added or removed, in order */
+        typedef std::list<std::pair<Target, bool>> ChangeList;
+
+        void queue(const Target & target, bool add, const void * origin);
+
+        /**
+         * Adds the change to the queue, without journaling it.
+         */
+        void insert(const Target & target, bool add, const void * origin);
+
+        /**
+         * Runs in the writer thread, forever.
+         */
+        void write();
+
+        /**
+         * Puts back changes which couldn't be written, ahead of those queued
+         * since, unless those replace them.
+         */
+        void requeue(ChangeList & changes, const void * origin, bool mixedOrigins);
+
+        /**
+         * Appends a line for each change to the journal, and syncs it.
+         */
+        void journal(ChangeList::const_iterator begin, ChangeList::const_iterator end);
+
+        void reportJournalError(const std::string & action);
+
+        /* Guards everything below */
+        std::mutex _mutex;
+        std::condition_variable _wakeup;
+        std::condition_variable _written;
+
+        ChangeList _changes;
+        std::map<Target, ChangeList::iterator> _changeIndex;
+
+        /* What made the queued changes, or NULL if several things did */
+        const void * _origin;
+        bool _mixedOrigins;
+
+        struct Job
+        {
+            Notmuch::TagTransaction transaction;
+            std::promise<void> result;
+        };
+
+        std::deque<Job> _jobs;
+
+        struct Flush
+        {
+            unsigned long from;
+            unsigned long to;
+            const void * origin;
+        };
+
+        /* The most recent flushes made by a single origin */
+        std::deque<Flush> _flushes;
+
+        /* Whether the writer is writing, and how many writes have failed */
+        bool _writing;
+        unsigned _failures;
+
+        std::string _error;
+
+        int _journal;
+
+        std::chrono::steady_clock::time_point _retryTime;
+        std::chrono::milliseconds _retryDelay;
+};
+
+#endif
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
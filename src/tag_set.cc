@@ -0,0 +1,165 @@
+/* ner: src/tag_set.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tag_set.hh"
+
+TagDictionary & TagDictionary::instance()
+{
+    static TagDictionary * dictionary = NULL;
+
+    if (!dictionary)
+        dictionary = new TagDictionary();
+
+    return *dictionary;
+}
+
+TagDictionary::TagDictionary()
+{
+}
+
+TagDictionary::~TagDictionary()
+{
+}
+
+TagID TagDictionary::intern(const std::string & name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto id = _ids.find(name);
+
+    if (id != _ids.end())
+        return id->second;
+
+    TagID tag = _names.size();
+    _names.push_back(name);
+    _ids.insert(std::make_pair(name, tag));
+
+    return tag;
+}
+
+const std::string & TagDictionary::name(TagID tag)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _names.at(tag);
+}
+
+TagSet::TagSet()
+    : _low(0)
+{
+}
+
+bool TagSet::empty() const
+{
+    if (_low)
+        return false;
+
+    for (auto word = _high.begin(), e = _high.end(); word != e; ++word)
+    {
+        if (*word)
+            return false;
+    }
+
+    return true;
+}
+
+void TagSet::insert(TagID tag)
+{
+    if (tag < 64)
+    {
+        _low |= uint64_t(1) << tag;
+        return;
+    }
+
+    tag -= 64;
+
+    if (tag / 64 >= _high.size())
+        _high.resize(tag / 64 + 1);
+
+    _high[tag / 64] |= uint64_t(1) << (tag % 64);
+}
+
+void TagSet::erase(TagID tag)
+{
+    if (tag < 64)
+    {
+        _low &= ~(uint64_t(1) << tag);
+        return;
+    }
+
+    tag -= 64;
+
+    if (tag / 64 < _high.size())
+        _high[tag / 64] &= ~(uint64_t(1) << (tag % 64));
+}
+
+bool TagSet::operator==(const TagSet & other) const
+{
+    if (_low != other._low)
+        return false;
+
+    /* Erasing tags can leave trailing zero words behind */
+    std::size_t words = std::max(_high.size(), other._high.size());
+
+    for (std::size_t word = 0; word < words; ++word)
+    {
+        uint64_t bits = word < _high.size() ? _high[word] : 0;
+        uint64_t otherBits = word < other._high.size() ? other._high[word] : 0;
+
+        if (bits != otherBits)
+            return false;
+    }
+
+    return true;
+}
+
+TagSet & TagSet::operator|=(const TagSet & other)
+{
+    _low |= other._low;
+
+    if (other._high.size() > _high.size())
+        _high.resize(other._high.size());
+
+    for (std::size_t word = 0; word < other._high.size(); ++word)
+        _high[word] |= other._high[word];
+
+    return *this;
+}
+
+std::string TagDictionary::join(const TagSet & set)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::string string;
+
+    set.forEach([&] (TagID tag) {
+        if (!string.empty())
+            string.push_back(' ');
+
+        string.append(_names.at(tag));
+    });
+
+    return string;
+}
+
+std::string TagSet::toString() const
+{
+    return TagDictionary::instance().join(*this);
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
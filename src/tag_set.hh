@@ -0,0 +1,136 @@
+/* ner: src/tag_set.hh
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NER_TAG_SET_H
+#define NER_TAG_SET_H 1
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+
+typedef uint32_t TagID;
+
+/**
+ * The process-wide table of interned tag names.
+ *
+ * Tags are numbered in the order they are interned, so seeding the table with
+ * the sorted tag list from the database makes tag sets display in
+ * alphabetical order.
+ *
+ * This class is a singleton.
+ */
+class TagSet;
+
+class TagDictionary
+{
+    public:
+        static TagDictionary & instance();
+
+        /**
+         * Returns the ID of the given tag, adding it to the table if needed.
+         */
+        TagID intern(const std::string & name);
+
+        /**
+         * Returns the name of the tag with the given ID.
+         */
+        const std::string & name(TagID tag);
+
+        /**
+         * Joins the names of the tags in set with spaces, in ID order.
+         */
+        std::string join(const TagSet & set);
+
+    private:
+        TagDictionary();
+        ~TagDictionary();
+
+        std::mutex _mutex;
+        std::map<std::string, TagID> _ids;
+
+        /* A deque, so that references to the names stay valid */
+        std::deque<std::string> _names;
+};
+
+/**
+ * A set of interned tags, stored as a bitset.
+ *
+ * The first 64 tags fit in a single word, so for most databases, tag sets
+ * never allocate.
+ */
+class TagSet
+{
+    public:
+        TagSet();
+
+        bool contains(TagID tag) const
+        {
+            if (tag < 64)
+                return (_low >> tag) & 1;
+
+            tag -= 64;
+            return tag / 64 < _high.size() && (_high[tag / 64] >> (tag % 64)) & 1;
+        }
+
+        bool empty() const;
+
+        void insert(TagID tag);
+        void erase(TagID tag);
+
+        TagSet & operator|=(const TagSet & other);
+
+        bool operator==(const TagSet & other) const;
+        bool operator!=(const TagSet & other) const { return !(*this == other); }
+
+        /**
+         * Calls function with the ID of each tag in the set, in ID order.
+         */
+        template <class Function>
+            void forEach(Function function) const
+        {
+            forEachBit(_low, 0, function);
+
+            for (std::size_t word = 0; word < _high.size(); ++word)
+                forEachBit(_high[word], 64 * (word + 1), function);
+        }
+
+        /**
+         * Joins the names of the tags in the set with spaces.
+         */
+        std::string toString() const;
+
+    private:
+        template <class Function>
+            static void forEachBit(uint64_t bits, TagID base, Function & function)
+        {
+            for (; bits; bits &= bits - 1)
+                function(base + __builtin_ctzll(bits));
+        }
+
+        uint64_t _low;
+        std::vector<uint64_t> _high;
+};
+
+#endif
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
+
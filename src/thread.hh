@@ -2,9 +2,9 @@
 #define NER_THREAD_H 1
 
 #include <string>
-#include <set>
 
 #include "message.hh"
+#include "tag_set.hh"
 
 #include "notmuch.h"
 
@@ -26,8 +26,6 @@ class Thread
         Thread(notmuch_thread_t * thread);
 
 
-        void topLevelMessages(std::vector<Message> & messages);
-
         void addTag(std::string tag);
         void removeTag(std::string tag);
 
@@ -42,7 +40,7 @@ class Thread
         time_t newestDate;
         time_t oldestDate;
 
-        std::set<std::string> tags;
+        TagSet tags;
 };
 
 #endif /* NER_THREAD_H */
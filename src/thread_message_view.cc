@@ -75,6 +75,10 @@ ThreadMessageView::ThreadMessageView(const std::string & threadId, const View::G
 	addHandledSequence(_keymap.find("toggleFolding")->second, std::bind(&MessageView::toggleSelectedPartFolding, &_messageView));
     else
 	addHandledSequence("f", std::bind(&MessageView::toggleSelectedPartFolding, &_messageView));
+    if (_keymap.count("toggleThreadFolding") == 1)
+	addHandledSequence(_keymap.find("toggleThreadFolding")->second, std::bind(&ThreadView::toggleSelectedFolding, &_threadView));
+    else
+	addHandledSequence("z", std::bind(&ThreadView::toggleSelectedFolding, &_threadView));
 
     if (_generalKeymap.count("addTags") == 1)
 	addHandledSequence(_generalKeymap.find("addTags")->second, std::bind(&ThreadMessageView::addTags, this));
@@ -127,6 +131,11 @@ void ThreadMessageView::resize(const View::Geometry & geometry)
     });
 }
 
+bool ThreadMessageView::busy() const
+{
+    return _messageView.busy();
+}
+
 void ThreadMessageView::nextMessage()
 {
     _threadView.next();
@@ -143,10 +152,13 @@ void ThreadMessageView::previousMessage()
 
 void ThreadMessageView::loadSelectedMessage()
 {
-    _messageView.setMessage(_threadView.selectedMessage().id);
+    _prefetcher.collect();
+
+    _messageView.setMessage(_threadView.selectedMessageId());
+    _threadView.changeSelectedMessageTags({ "unread" }, false);
 
-    Message message = Notmuch::getMessage(_threadView.selectedMessage().id);
-    message.removeTag("unread");
+    _prefetcher.prefetch(_threadView.nearbyMessageFilenames(
+        NerConfig::instance().messagePrefetchDepth()));
 }
 
 std::vector<std::string> ThreadMessageView::status() const
@@ -160,9 +172,6 @@ std::vector<std::string> ThreadMessageView::status() const
 
 void ThreadMessageView::addTags()
 {
-    std::string _messageId = _threadView.selectedMessage().id;
-    Message message = Notmuch::getMessage(_messageId);
-
     try
     {
         std::string tags = StatusBar::instance().prompt("Tags: ", "tags");
@@ -170,11 +179,14 @@ void ThreadMessageView::addTags()
         if (!tags.empty()) {
             std::stringstream ss(tags);
             std::string s;
+            std::vector<std::string> tagList;
 
             while (std::getline(ss, s, ' ')) {
-                message.addTag(s);
+                tagList.push_back(s);
             }
 
+            _threadView.changeSelectedMessageTags(tagList, true);
+
             update();
         }
     }
@@ -185,9 +197,6 @@ void ThreadMessageView::addTags()
 
 void ThreadMessageView::removeTags()
 {
-    std::string _messageId = _threadView.selectedMessage().id;
-    Message message = Notmuch::getMessage(_messageId);
-
     try
     {
         std::string tags = StatusBar::instance().prompt("Tags: ", "tags");
@@ -195,11 +204,14 @@ void ThreadMessageView::removeTags()
         if (!tags.empty()) {
             std::stringstream ss(tags);
             std::string s;
+            std::vector<std::string> tagList;
 
             while (std::getline(ss, s, ' ')) {
-                message.removeTag(s);
+                tagList.push_back(s);
             }
 
+            _threadView.changeSelectedMessageTags(tagList, false);
+
             update();
         }
     }
@@ -22,6 +22,7 @@
 
 #include "thread_view.hh"
 #include "message_view.hh"
+#include "message_prefetcher.hh"
 
 class ThreadMessageView : public View
 {
@@ -33,6 +34,7 @@ class ThreadMessageView : public View
         virtual void update();
         virtual void refresh();
         virtual void resize(const View::Geometry & geometry = View::Geometry());
+        virtual bool busy() const;
 
         virtual std::string name() const { return "thread-message-view"; }
         virtual std::vector<std::string> status() const;
@@ -49,6 +51,8 @@ class ThreadMessageView : public View
     private:
         ThreadView _threadView;
         MessageView _messageView;
+
+        MessagePrefetcher _prefetcher;
 };
 
 #endif
@@ -0,0 +1,168 @@
+/* ner: src/thread_store.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <algorithm>
+
+#include "thread_store.hh"
+
+const std::size_t arenaBlockSize = 16 * 1024;
+
+ThreadStore::ThreadStore()
+    : _base(0), _first(0), _end(0)
+{
+}
+
+void ThreadStore::append(notmuch_thread_t * thread)
+{
+    Segment & segment = nextSegment();
+    int offset = this->offset(_end);
+
+    segment.ids[offset] = segment.store(notmuch_thread_get_thread_id(thread));
+    segment.subjects[offset] = segment.store(notmuch_thread_get_subject(thread) ? : "(null)");
+    segment.authors[offset] = segment.store(notmuch_thread_get_authors(thread) ? : "(null)");
+
+    segment.totalMessages[offset] = notmuch_thread_get_total_messages(thread);
+    segment.matchedMessages[offset] = notmuch_thread_get_matched_messages(thread);
+
+    segment.newestDates[offset] = notmuch_thread_get_newest_date(thread);
+    segment.oldestDates[offset] = notmuch_thread_get_oldest_date(thread);
+
+    TagSet & tags = segment.tags[offset];
+    TagDictionary & dictionary = TagDictionary::instance();
+
+    tags = TagSet();
+
+    notmuch_tags_t * tagIterator;
+    for (tagIterator = notmuch_thread_get_tags(thread);
+        notmuch_tags_valid(tagIterator);
+        notmuch_tags_move_to_next(tagIterator))
+    {
+        tags.insert(dictionary.intern(notmuch_tags_get(tagIterator)));
+    }
+
+    notmuch_tags_destroy(tagIterator);
+
+    ++_end;
+}
+
+void ThreadStore::append(const ThreadStore & other, int index)
+{
+    Segment & segment = nextSegment();
+    int offset = this->offset(_end);
+
+    segment.ids[offset] = segment.store(other.id(index));
+    segment.subjects[offset] = segment.store(other.subject(index));
+    segment.authors[offset] = segment.store(other.authors(index));
+
+    segment.totalMessages[offset] = other.totalMessages(index);
+    segment.matchedMessages[offset] = other.matchedMessages(index);
+
+    segment.newestDates[offset] = other.newestDate(index);
+    segment.oldestDates[offset] = other.oldestDate(index);
+
+    segment.tags[offset] = other.tags(index);
+
+    ++_end;
+}
+
+void ThreadStore::dropBefore(int index)
+{
+    if (index <= _first)
+        return;
+
+    if (index >= end())
+    {
+        clear(index);
+        return;
+    }
+
+    _first = index;
+
+    while (_first - _base >= segmentSize)
+    {
+        _segments.pop_front();
+        _base += segmentSize;
+    }
+}
+
+void ThreadStore::clear(int first)
+{
+    _segments.clear();
+
+    _base = first;
+    _first = first;
+    _end = first;
+}
+
+void ThreadStore::swap(ThreadStore & other)
+{
+    std::swap(_base, other._base);
+    std::swap(_first, other._first);
+    std::swap(_end, other._end);
+
+    _segments.swap(other._segments);
+}
+
+std::size_t ThreadStore::memoryUsage() const
+{
+    std::size_t size = sizeof(ThreadStore);
+
+    for (auto segment = _segments.begin(), e = _segments.end(); segment != e; ++segment)
+    {
+        size += sizeof(Segment) + (*segment)->arenaSize +
+            (*segment)->blocks.capacity() * sizeof(std::unique_ptr<char[]>);
+    }
+
+    return size;
+}
+
+ThreadStore::Segment & ThreadStore::nextSegment()
+{
+    if (_end - _base == int(_segments.size()) * segmentSize)
+        _segments.push_back(std::unique_ptr<Segment>(new Segment));
+
+    return *_segments.back();
+}
+
+ThreadStore::Segment::Segment()
+    : blockSize(0), blockUsed(0), arenaSize(0)
+{
+}
+
+const char * ThreadStore::Segment::store(const char * string)
+{
+    std::size_t length = std::strlen(string) + 1;
+
+    if (blocks.empty() || blockUsed + length > blockSize)
+    {
+        blockSize = std::max(arenaBlockSize, length);
+        blocks.push_back(std::unique_ptr<char[]>(new char[blockSize]));
+        blockUsed = 0;
+        arenaSize += blockSize;
+    }
+
+    char * destination = blocks.back().get() + blockUsed;
+    std::memcpy(destination, string, length);
+    blockUsed += length;
+
+    return destination;
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
@@ -0,0 +1,143 @@
+/* ner: src/thread_store.hh
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NER_THREAD_STORE_H
+#define NER_THREAD_STORE_H 1
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <time.h>
+#include <stdint.h>
+
+#include "tag_set.hh"
+
+#include <notmuch.h>
+
+/**
+ * Compact storage for the summaries of a list of threads.
+ *
+ * The threads are kept in fixed-size segments, which hold the fields in
+ * parallel arrays and pack the strings into an arena of their own. Adding a
+ * thread never moves the ones already stored, so references to them stay
+ * valid, and a long list grows without copying it.
+ *
+ * Indices are absolute: dropping threads from the front does not renumber the
+ * remaining ones, so first() is the index of the first thread still stored.
+ */
+class ThreadStore
+{
+    public:
+        ThreadStore();
+        ThreadStore(const ThreadStore &) = delete;
+        ThreadStore & operator=(const ThreadStore &) = delete;
+
+        void append(notmuch_thread_t * thread);
+
+        /**
+         * Copies the thread at index in other to the end of this store.
+         */
+        void append(const ThreadStore & other, int index);
+
+        /**
+         * Drops the threads before index, releasing the segments which no
+         * longer hold any of the remaining threads.
+         */
+        void dropBefore(int index);
+
+        /**
+         * Removes all threads, and starts numbering them at first.
+         */
+        void clear(int first = 0);
+
+        void swap(ThreadStore & other);
+
+        bool empty() const { return _end == _first; }
+
+        int first() const { return _first; }
+        int end() const { return _end; }
+        bool contains(int index) const { return index >= first() && index < end(); }
+
+        const char * id(int index) const { return segment(index).ids[offset(index)]; }
+        const char * subject(int index) const { return segment(index).subjects[offset(index)]; }
+        const char * authors(int index) const { return segment(index).authors[offset(index)]; }
+
+        uint32_t totalMessages(int index) const { return segment(index).totalMessages[offset(index)]; }
+        uint32_t matchedMessages(int index) const { return segment(index).matchedMessages[offset(index)]; }
+
+        time_t newestDate(int index) const { return segment(index).newestDates[offset(index)]; }
+        time_t oldestDate(int index) const { return segment(index).oldestDates[offset(index)]; }
+
+        TagSet & tags(int index) { return segment(index).tags[offset(index)]; }
+        const TagSet & tags(int index) const { return segment(index).tags[offset(index)]; }
+
+        /**
+         * The number of bytes used by the store, including its arenas, but not
+         * the words of tag sets beyond the first 64 tags.
+         */
+        std::size_t memoryUsage() const;
+
+    private:
+        static const int segmentSize = 512;
+
+        struct Segment
+        {
+            Segment();
+
+            const char * store(const char * string);
+
+            const char * ids[segmentSize];
+            const char * subjects[segmentSize];
+            const char * authors[segmentSize];
+
+            uint32_t totalMessages[segmentSize];
+            uint32_t matchedMessages[segmentSize];
+
+            time_t newestDates[segmentSize];
+            time_t oldestDates[segmentSize];
+
+            TagSet tags[segmentSize];
+
+            /* The string arena */
+            std::vector<std::unique_ptr<char[]>> blocks;
+            std::size_t blockSize;
+            std::size_t blockUsed;
+            std::size_t arenaSize;
+        };
+
+        Segment & segment(int index) const { return *_segments[(index - _base) / segmentSize]; }
+        int offset(int index) const { return (index - _base) % segmentSize; }
+
+        /**
+         * Makes room for a thread at end(), and returns its segment.
+         */
+        Segment & nextSegment();
+
+        /* The index of the first slot in the first segment */
+        int _base;
+        int _first;
+        int _end;
+
+        std::deque<std::unique_ptr<Segment>> _segments;
+};
+
+#endif
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
+
@@ -29,23 +29,26 @@
 #include "message_view.hh"
 #include "status_bar.hh"
 #include "reply_view.hh"
+#include "tag_queue.hh"
+#include "message.hh"
+
+/* Rows are cut off long before this many tree lines */
+const uint32_t maxGlyphs = 512;
 
 ThreadView::ThreadView(const std::string & threadId, const View::Geometry & geometry)
-    : LineBrowserView(geometry), _id(threadId)
+    : LineBrowserView(geometry), _id(threadId), _revision(0),
+        _unreadTag(TagDictionary::instance().intern("unread"))
 {
     refreshMessages();
 
     _selectedIndex = 0;
 
     /* Find first unread message */
-    int messageIndex = 0;
-
-    for (Message::const_iterator message(_topMessages.rbegin(), _topMessages.rend()), e;
-        message != e; ++message, ++messageIndex)
+    for (int row = 0; row < int(_rows.size()); ++row)
     {
-        if (message->tags.find("unread") != message->tags.end())
+        if (_messages.tags(_rows[row].message).contains(_unreadTag))
         {
-            _selectedIndex = messageIndex;
+            _selectedIndex = row;
             break;
         }
     }
@@ -63,6 +66,13 @@ ThreadView::ThreadView(const std::string & threadId, const View::Geometry & geom
 	addHandledSequence(_generalKeymap.find("reply")->second, std::bind(&ThreadView::reply, this));
     else
 	addHandledSequence("r", std::bind(&ThreadView::reply, this));
+
+    std::map<std::string, std::string> _keymap = NerConfig::instance().getThreadViewKeyMap();
+
+    if (_keymap.count("toggleThreadFolding") == 1)
+	addHandledSequence(_keymap.find("toggleThreadFolding")->second, std::bind(&ThreadView::toggleSelectedFolding, this));
+    else
+	addHandledSequence("z", std::bind(&ThreadView::toggleSelectedFolding, this));
 }
 
 ThreadView::~ThreadView()
@@ -71,28 +81,103 @@ ThreadView::~ThreadView()
 
 void ThreadView::refreshMessages()
 {
-    Thread & thread = Notmuch::getThread(_id);
+    notmuch_database_t * database = Notmuch::readonlyDatabase();
+    unsigned long revision = Notmuch::revision(database);
+
+    /* If our own changes were the only ones written since loading, we are
+     * still up to date */
+    if (!_messages.empty() && TagQueue::instance().follow(_revision, this) == revision)
+    {
+        Notmuch::releaseDatabase(database);
+        _revision = revision;
+        return;
+    }
+
+    const NerConfig & config = NerConfig::instance();
+
+    _revision = revision;
+
+    _messages.load(database, _id, config.threadFoldDepth(), config.threadFoldSize());
 
-    _messageCount = thread.totalMessages;
-    thread.topLevelMessages(_topMessages);
+    layoutMessages();
 }
 
-void ThreadView::update()
+void ThreadView::layoutMessages()
+{
+    _rows.clear();
+    _glyphs.clear();
+
+    /* The row of each message, or -1 if it is hidden */
+    std::vector<int> messageRows(_messages.size(), -1);
+
+    int message = _messages.empty() ? -1 : 0;
+
+    while (message != -1)
+    {
+        int parent = _messages.parent(message);
+        Row row = { message, uint32_t(_glyphs.size()), 0 };
+
+        /* Our lines are those of our parent, with its corner turned into
+         * either a line down to its next sibling, or nothing. Past
+         * maxGlyphs, the row is cut off anyway, so we stop adding any. */
+        if (parent != -1)
+        {
+            const Row & parentRow = _rows[messageRows[parent]];
+            bool hasCorner = uint32_t(_messages.depth(parent)) < maxGlyphs;
+            uint32_t count = parentRow.glyphCount - (hasCorner ? 1 : 0);
+
+            _glyphs.reserve(_glyphs.size() + count + 2);
+
+            for (uint32_t glyph = 0; glyph < count; ++glyph)
+                _glyphs.push_back(_glyphs[parentRow.glyphs + glyph]);
+
+            if (hasCorner)
+                _glyphs.push_back(_messages.nextSibling(parent) == -1 ? ' ' : ACS_VLINE);
+        }
+
+        if (_glyphs.size() - row.glyphs < maxGlyphs)
+            _glyphs.push_back(_messages.nextSibling(message) == -1 ? ACS_LLCORNER : ACS_LTEE);
+
+        row.glyphCount = _glyphs.size() - row.glyphs;
+        messageRows[message] = _rows.size();
+        _rows.push_back(row);
+
+        /* Move on to the next visible message in display order */
+        if (!_messages.folded(message) && _messages.firstChild(message) != -1)
+            message = _messages.firstChild(message);
+        else
+        {
+            while (message != -1 && _messages.nextSibling(message) == -1)
+                message = _messages.parent(message);
+
+            if (message != -1)
+                message = _messages.nextSibling(message);
+        }
+    }
+
+    if (_selectedIndex >= int(_rows.size()))
+        _selectedIndex = std::max(int(_rows.size()) - 1, 0);
+}
+
+int ThreadView::selectedMessage() const
 {
-    std::vector<chtype> leading;
+    if (_selectedIndex >= int(_rows.size()))
+        return -1;
+
+    return _rows[_selectedIndex].message;
+}
 
+void ThreadView::update()
+{
     refreshMessages();
     makeSelectionVisible();
 
     werase(_window);
 
-    int index = 0;
-
-    for (auto message = _topMessages.begin(), e = _topMessages.end();
-        message != e && index < getmaxy(_window) + _offset;
-        ++message)
+    for (int row = _offset; row < int(_rows.size()) &&
+        row < getmaxy(_window) + _offset; ++row)
     {
-        index = displayMessageLine(*message, leading, (message + 1) == e, index);
+        displayMessageLine(row);
     }
 }
 
@@ -100,7 +185,7 @@ std::vector<std::string> ThreadView::status() const
 {
     std::ostringstream messagePosition;
 
-    messagePosition << "message " << (_selectedIndex + 1) << " of " << _messageCount;
+    messagePosition << "message " << (_selectedIndex + 1) << " of " << _rows.size();
 
     return std::vector<std::string>{
         "thread:" + _id,
@@ -113,7 +198,7 @@ void ThreadView::openSelectedMessage()
     try
     {
         std::shared_ptr<MessageView> messageView(new MessageView());
-        messageView->setMessage(selectedMessage().id);
+        messageView->setMessage(selectedMessageId());
         ViewManager::instance().addView(messageView);
     }
     catch (const InvalidMessageException & e)
@@ -122,18 +207,84 @@ void ThreadView::openSelectedMessage()
     }
 }
 
-const Message & ThreadView::selectedMessage() const
+std::string ThreadView::selectedMessageId() const
+{
+    int message = selectedMessage();
+
+    if (message == -1)
+        return std::string();
+
+    return _messages.id(message);
+}
+
+std::vector<std::string> ThreadView::nearbyMessageFilenames(int distance) const
+{
+    std::vector<std::string> filenames;
+
+    if (selectedMessage() == -1)
+        return filenames;
+
+    for (int step = 1; step <= distance; ++step)
+    {
+        if (_selectedIndex + step < int(_rows.size()))
+            filenames.push_back(_messages.filename(_rows[_selectedIndex + step].message));
+
+        if (_selectedIndex - step >= 0)
+            filenames.push_back(_messages.filename(_rows[_selectedIndex - step].message));
+    }
+
+    return filenames;
+}
+
+void ThreadView::changeSelectedMessageTags(const std::vector<std::string> & tags, bool add)
+{
+    int selected = selectedMessage();
+
+    if (selected == -1)
+        return;
+
+    MessageHandle message(_messages.id(selected));
+
+    for (auto tag = tags.begin(), e = tags.end(); tag != e; ++tag)
+    {
+        if (add)
+            message.addTag(*tag, this);
+        else
+            message.removeTag(*tag, this);
+    }
+
+    TagDictionary & dictionary = TagDictionary::instance();
+
+    for (auto tag = tags.begin(), e = tags.end(); tag != e; ++tag)
+    {
+        if (tag->empty())
+            continue;
+
+        if (add)
+            _messages.tags(selected).insert(dictionary.intern(*tag));
+        else
+            _messages.tags(selected).erase(dictionary.intern(*tag));
+    }
+}
+
+void ThreadView::toggleSelectedFolding()
 {
-    Message::const_iterator message(_topMessages.rbegin(), _topMessages.rend());
-    std::advance(message, _selectedIndex);
-    return *message;
+    int selected = selectedMessage();
+
+    if (selected == -1 || _messages.replyCount(selected) == 0)
+        return;
+
+    _messages.setFolded(selected, !_messages.folded(selected));
+
+    /* The selected row stays where it is, since only rows below it change */
+    layoutMessages();
 }
 
 void ThreadView::reply()
 {
     try
     {
-        ViewManager::instance().addView(std::make_shared<ReplyView>(selectedMessage().id));
+        ViewManager::instance().addView(std::make_shared<ReplyView>(selectedMessageId()));
     }
     catch (const InvalidMessageException & e)
     {
@@ -143,97 +294,75 @@ void ThreadView::reply()
 
 int ThreadView::lineCount() const
 {
-    return _messageCount;
+    return _rows.size();
 }
 
-uint32_t ThreadView::displayMessageLine(const Message & message,
-    std::vector<chtype> & leading, bool last, int index)
+void ThreadView::displayMessageLine(int row)
 {
-    if (index >= _offset)
+    int index = _rows[row].message;
+
+    try
     {
-        try
-        {
-            bool selected = index == _selectedIndex;
-            bool unread = message.tags.find("unread") != message.tags.end();
+        bool selected = row == _selectedIndex;
+        bool unread = _messages.tags(index).contains(_unreadTag);
 
-            int x = 0;
-            int row = index - _offset;
+        int x = 0;
 
-            wmove(_window, row, x);
+        wmove(_window, row - _offset, x);
 
-            attr_t attributes = 0;
+        attr_t attributes = 0;
 
-            if (selected)
-                attributes |= A_REVERSE;
+        if (selected)
+            attributes |= A_REVERSE;
 
-            if (unread)
-                attributes |= A_BOLD;
+        if (unread)
+            attributes |= A_BOLD;
 
-            wchgat(_window, -1, attributes, 0, NULL);
+        wchgat(_window, -1, attributes, 0, NULL);
 
-            x += NCurses::addPlainString(_window, leading.begin(), leading.end(),
-                attributes, ColorID::ThreadViewArrow);
+        auto glyphs = _glyphs.begin() + _rows[row].glyphs;
 
-            NCurses::checkMove(_window, x);
+        x += NCurses::addPlainString(_window, glyphs, glyphs + _rows[row].glyphCount,
+            attributes, ColorID::ThreadViewArrow);
 
-            x += NCurses::addChar(_window, last ? ACS_LLCORNER : ACS_LTEE,
-                attributes, ColorID::ThreadViewArrow);
+        NCurses::checkMove(_window, x);
 
-            NCurses::checkMove(_window, x);
+        if (_messages.folded(index))
+        {
+            /* Folded replies */
+            std::ostringstream replyCount;
+            replyCount << '+' << _messages.replyCount(index);
 
+            x += NCurses::addPlainString(_window, replyCount.str(), attributes,
+                ColorID::ThreadViewArrow);
+        }
+        else
             x += NCurses::addChar(_window, '>', attributes, ColorID::ThreadViewArrow);
 
-            NCurses::checkMove(_window, ++x);
-
-            /* Sender */
-            x += NCurses::addUtf8String(_window, (*message.headers.find("From")).second.c_str(),
-                attributes);
+        NCurses::checkMove(_window, ++x);
 
-            NCurses::checkMove(_window, ++x);
+        /* Sender */
+        x += NCurses::addUtf8String(_window, _messages.sender(index).c_str(),
+            attributes);
 
-            /* Date */
-            x += NCurses::addPlainString(_window, relativeTime(message.date),
-                attributes, ColorID::ThreadViewDate);
+        NCurses::checkMove(_window, ++x);
 
-            NCurses::checkMove(_window, ++x);
+        /* Date */
+        x += NCurses::addPlainString(_window, relativeTime(_messages.date(index)),
+            attributes, ColorID::ThreadViewDate);
 
-            /* Tags */
-            std::ostringstream tagStream;
-            std::copy(message.tags.begin(), message.tags.end(),
-                std::ostream_iterator<std::string>(tagStream, " "));
-            std::string tags(tagStream.str());
+        NCurses::checkMove(_window, ++x);
 
-            if (tags.size() > 0)
-                /* Get rid of the trailing space */
-                tags.resize(tags.size() - 1);
+        /* Tags */
+        x += NCurses::addPlainString(_window, _messages.tags(index).toString(),
+            attributes, ColorID::ThreadViewTags);
 
-            x += NCurses::addPlainString(_window, tags, attributes, ColorID::ThreadViewTags);
-
-            NCurses::checkMove(_window, x - 1);
-        }
-        catch (const NCurses::CutOffException & e)
-        {
-            NCurses::addCutOffIndicator(_window);
-        }
+        NCurses::checkMove(_window, x - 1);
     }
-
-    ++index;
-
-    if (last)
-        leading.push_back(' ');
-    else
-        leading.push_back(ACS_VLINE);
-
-    for (auto reply = message.replies.begin(), e = message.replies.end();
-        reply != e && index < getmaxy(_window) + _offset;
-        ++reply)
+    catch (const NCurses::CutOffException & e)
     {
-        index = displayMessageLine(*reply, leading, (reply + 1) == e, index);
+        NCurses::addCutOffIndicator(_window);
     }
-
-    leading.pop_back();
-
-    return index;
 }
 
 // vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
@@ -24,7 +24,7 @@
 
 #include "line_browser_view.hh"
 #include "notmuch.hh"
-#include "message.hh"
+#include "message_tree.hh"
 
 class ThreadView : public LineBrowserView
 {
@@ -37,9 +37,26 @@ class ThreadView : public LineBrowserView
         virtual std::string name() const { return "thread-view"; }
         virtual std::vector<std::string> status() const;
 
-        const Message & selectedMessage() const;
+        std::string selectedMessageId() const;
+
+        /**
+         * The files of the messages up to distance rows away from the
+         * selected one, nearest first, and following before preceding.
+         */
+        std::vector<std::string> nearbyMessageFilenames(int distance) const;
         virtual void openSelectedMessage();
 
+        /**
+         * Adds or removes tags on the selected message, updating the loaded
+         * messages rather than reloading the thread.
+         */
+        void changeSelectedMessageTags(const std::vector<std::string> & tags, bool add);
+
+        /**
+         * Folds or unfolds the replies to the selected message.
+         */
+        void toggleSelectedFolding();
+
         void reply();
 
     protected:
@@ -48,12 +65,43 @@ class ThreadView : public LineBrowserView
         std::string _id;
 
     private:
+        /**
+         * Reloads the messages if the database changed since they were
+         * loaded.
+         */
         void refreshMessages();
-        uint32_t displayMessageLine(const Message & message,
-            std::vector<chtype> & leading, bool last, int index);
 
-        std::vector<Message> _topMessages;
-        int _messageCount;
+        /**
+         * Lays out a row for each message, with the tree lines leading up to
+         * it.
+         */
+        void layoutMessages();
+
+        /**
+         * The message shown in the selected row, or -1.
+         */
+        int selectedMessage() const;
+
+        void displayMessageLine(int row);
+
+        struct Row
+        {
+            int message;
+
+            /* The tree lines and arrow corner, in _glyphs */
+            uint32_t glyphs;
+            uint32_t glyphCount;
+        };
+
+        MessageTree _messages;
+
+        std::vector<Row> _rows;
+        std::vector<chtype> _glyphs;
+
+        /* The revision of the database _messages was loaded at */
+        unsigned long _revision;
+
+        TagID _unreadTag;
 };
 
 #endif
@@ -0,0 +1,258 @@
+/* ner: src/thread_window.cc
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <map>
+#include <cstring>
+
+#include "thread_window.hh"
+#include "notmuch.hh"
+#include "ner_config.hh"
+
+/* The number of walked thread IDs which are always kept, so moving the window
+ * back that far doesn't walk the query again. Up to twice as many are kept,
+ * so the oldest can be dropped in bulk. */
+const std::size_t maxIndexedThreads = 4096;
+
+ThreadWindow::ThreadWindow(const std::string & query, int margin)
+    : _query(query), _margin(std::max(margin, 1)),
+        _database(NULL), _iterator(NULL),
+        _position(0), _firstIndexed(0)
+{
+    open();
+}
+
+ThreadWindow::~ThreadWindow()
+{
+    close();
+}
+
+void ThreadWindow::fetch(int first, int count)
+{
+    int from = std::max(first - _margin, 0);
+    int to = first + count + _margin;
+
+    /* Start a new window if the requested range is before this one, or well
+     * past its end */
+    if (first < _threads.first() || from > _threads.end())
+    {
+        if (from < _firstIndexed)
+        {
+            restart();
+            skipTo(from);
+        }
+        else if (from < _position)
+            _threads.clear(from);
+        else
+            skipTo(from);
+    }
+
+    while (_threads.end() < to)
+    {
+        if (_threads.end() < _position)
+            appendWalked(std::min(to, _position));
+        else if (notmuch_threads_valid(_iterator))
+            appendNext();
+        else
+            break;
+    }
+
+    /* Drop the threads which scrolled out of the margin, a margin at a time
+     * so that scrolling line by line does not shuffle the store each time */
+    if (from - _threads.first() >= _margin)
+        _threads.dropBefore(from);
+}
+
+bool ThreadWindow::load(int index)
+{
+    if (!_threads.contains(index))
+        fetch(index, 1);
+
+    return _threads.contains(index);
+}
+
+int ThreadWindow::size() const
+{
+    return _position;
+}
+
+bool ThreadWindow::exhausted() const
+{
+    return !notmuch_threads_valid(_iterator);
+}
+
+void ThreadWindow::reset()
+{
+    close();
+    open();
+}
+
+void ThreadWindow::open()
+{
+    _database = Notmuch::readonlyDatabase();
+    restart();
+}
+
+void ThreadWindow::close()
+{
+    _notmuchQuery.reset();
+
+    if (_database)
+        Notmuch::releaseDatabase(_database);
+
+    _iterator = NULL;
+    _database = NULL;
+}
+
+void ThreadWindow::restart()
+{
+    _notmuchQuery.reset(notmuch_query_create(_database, _query.c_str()));
+    notmuch_query_set_sort(_notmuchQuery.get(), NerConfig::instance().sortMode());
+    _iterator = notmuch_query_search_threads(_notmuchQuery.get());
+
+    _threads.clear();
+    _position = 0;
+
+    _firstIndexed = 0;
+    _ids.clear();
+    _idOffsets.clear();
+}
+
+void ThreadWindow::skipTo(int index)
+{
+    /* notmuch only knows where the next thread starts once it has built the
+     * current one, so we still have to construct them, but don't keep them */
+    for (; _position < index && notmuch_threads_valid(_iterator);
+        notmuch_threads_move_to_next(_iterator), ++_position)
+    {
+        notmuch_thread_t * thread = notmuch_threads_get(_iterator);
+        indexThread(thread);
+        notmuch_thread_destroy(thread);
+    }
+
+    _threads.clear(_position);
+}
+
+void ThreadWindow::appendNext()
+{
+    notmuch_thread_t * thread = notmuch_threads_get(_iterator);
+    indexThread(thread);
+    _threads.append(thread);
+    notmuch_thread_destroy(thread);
+
+    notmuch_threads_move_to_next(_iterator);
+    ++_position;
+}
+
+void ThreadWindow::appendWalked(int end)
+{
+    int first = _threads.end();
+
+    /* Restrict the threads to the query, so their matched messages are
+     * counted as they were when they were walked */
+    std::string terms("(" + _query + ") and (");
+
+    for (int index = first; index < end; ++index)
+    {
+        if (index != first)
+            terms.append(" or ");
+
+        terms.append("thread:");
+        terms.append(id(index));
+    }
+
+    terms.append(")");
+
+    Notmuch::QueryPointer query(notmuch_query_create(_database, terms.c_str()));
+    std::map<std::string, notmuch_thread_t *> found;
+
+    notmuch_threads_t * threads;
+    for (threads = notmuch_query_search_threads(query.get());
+        notmuch_threads_valid(threads);
+        notmuch_threads_move_to_next(threads))
+    {
+        notmuch_thread_t * thread = notmuch_threads_get(threads);
+        found[notmuch_thread_get_thread_id(thread)] = thread;
+    }
+
+    /* Store them in the order they were walked */
+    for (int index = first; index < end;)
+    {
+        auto thread = found.find(id(index));
+
+        if (thread == found.end())
+        {
+            forget(index);
+            --end;
+        }
+        else
+        {
+            _threads.append(thread->second);
+            ++index;
+        }
+    }
+
+    for (auto thread = found.begin(), e = found.end(); thread != e; ++thread)
+        notmuch_thread_destroy(thread->second);
+}
+
+void ThreadWindow::indexThread(notmuch_thread_t * thread)
+{
+    const char * id = notmuch_thread_get_thread_id(thread);
+
+    _idOffsets.push_back(_ids.size());
+    _ids.insert(_ids.end(), id, id + std::strlen(id) + 1);
+
+    /* Drop the older half of the index once it is full */
+    if (_idOffsets.size() == 2 * maxIndexedThreads)
+    {
+        uint32_t dropped = _idOffsets[maxIndexedThreads];
+
+        _ids.erase(_ids.begin(), _ids.begin() + dropped);
+        _idOffsets.erase(_idOffsets.begin(), _idOffsets.begin() + maxIndexedThreads);
+
+        for (auto offset = _idOffsets.begin(), e = _idOffsets.end(); offset != e; ++offset)
+            *offset -= dropped;
+
+        _firstIndexed += maxIndexedThreads;
+    }
+}
+
+void ThreadWindow::forget(int index)
+{
+    std::size_t slot = index - _firstIndexed;
+    uint32_t begin = _idOffsets[slot];
+    uint32_t length = (slot + 1 < _idOffsets.size() ? _idOffsets[slot + 1] :
+        _ids.size()) - begin;
+
+    _ids.erase(_ids.begin() + begin, _ids.begin() + begin + length);
+    _idOffsets.erase(_idOffsets.begin() + slot);
+
+    for (auto offset = _idOffsets.begin() + slot, e = _idOffsets.end(); offset != e; ++offset)
+        *offset -= length;
+
+    --_position;
+}
+
+const char * ThreadWindow::id(int index) const
+{
+    return &_ids[_idOffsets[index - _firstIndexed]];
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
@@ -0,0 +1,142 @@
+/* ner: src/thread_window.hh
+ *
+ * Copyright (c) 2010 Michael Forney
+ *
+ * This file is a part of ner.
+ *
+ * ner is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License version 3, as published by the Free
+ * Software Foundation.
+ *
+ * ner is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ner.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NER_THREAD_WINDOW_H
+#define NER_THREAD_WINDOW_H 1
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "thread_store.hh"
+#include "notmuch.hh"
+
+#include <notmuch.h>
+
+/**
+ * A bounded window over the threads matching a search.
+ *
+ * Only the threads around the requested range are materialized. The notmuch
+ * iterator stays parked after the last thread walked, so moving the window
+ * forward only walks the new threads. The IDs of the most recently walked
+ * threads are kept in a compact, bounded index, so moving the window back
+ * within them looks up the threads it covers in a single query. Moving it
+ * back further walks the query again from the beginning.
+ *
+ * A walked thread which no longer matches the query when it is looked up
+ * again is dropped, and the threads after it move up.
+ */
+class ThreadWindow
+{
+    public:
+        /**
+         * \param query The notmuch search terms.
+         * \param margin The number of threads to keep materialized on either
+         *        side of the requested range.
+         */
+        ThreadWindow(const std::string & query, int margin);
+        ThreadWindow(const ThreadWindow &) = delete;
+        ThreadWindow & operator=(const ThreadWindow &) = delete;
+        ~ThreadWindow();
+
+        /**
+         * Makes sure the threads in [first, first + count) are materialized,
+         * as far as there are matching threads.
+         */
+        void fetch(int first, int count);
+
+        /**
+         * Makes sure the thread at the given index is stored, moving the
+         * window there if necessary.
+         *
+         * \return Whether there is a thread at that index.
+         */
+        bool load(int index);
+
+        /**
+         * The materialized threads, indexed by their position in the results.
+         */
+        ThreadStore & threads() { return _threads; }
+
+        /**
+         * The number of threads walked so far.
+         */
+        int size() const;
+
+        /**
+         * Whether every matching thread has been walked.
+         */
+        bool exhausted() const;
+
+        /**
+         * Reopens the database and starts over, dropping all threads.
+         */
+        void reset();
+
+    private:
+        void open();
+        void close();
+        void restart();
+        void skipTo(int index);
+
+        /**
+         * Stores the thread at the iterator, and moves past it.
+         */
+        void appendNext();
+
+        /**
+         * Looks up the walked threads from the end of the store up to end in
+         * the ID index, and stores them, dropping those which no longer
+         * match the query.
+         */
+        void appendWalked(int end);
+
+        void indexThread(notmuch_thread_t * thread);
+
+        /**
+         * Removes the walked thread at index, moving the ones after it up.
+         */
+        void forget(int index);
+
+        const char * id(int index) const;
+
+        std::string _query;
+        int _margin;
+
+        notmuch_database_t * _database;
+        Notmuch::QueryPointer _notmuchQuery;
+        notmuch_threads_t * _iterator;
+
+        /* The index of the thread the iterator is parked on */
+        int _position;
+
+        /* The IDs of the most recently walked threads, from _firstIndexed
+         * up to _position, packed into _ids, and the offset of each in
+         * _idOffsets */
+        int _firstIndexed;
+        std::vector<char> _ids;
+        std::vector<uint32_t> _idOffsets;
+
+        ThreadStore _threads;
+};
+
+#endif
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
+
@@ -21,6 +21,10 @@
 #include <stdio.h>
 #include <sstream>
 #include <iomanip>
+#include <limits>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #include "util.hh"
 
@@ -28,14 +32,19 @@
 #define HOUR (60 * MINUTE)
 #define DAY (24 * HOUR)
 
-std::string relativeTime(time_t rawTime)
+std::string relativeTime(time_t rawTime, time_t * expires)
 {
     time_t currentRawTime = time(0);
     struct tm currentLocalTime, localTime;
     char timeString[13];
 
     if (rawTime > currentRawTime)
+    {
+        if (expires)
+            *expires = rawTime;
+
         return "the future";
+    }
 
     localtime_r(&currentRawTime, &currentLocalTime);
     localtime_r(&rawTime, &localTime);
@@ -44,14 +53,36 @@ std::string relativeTime(time_t rawTime)
 
     if (difference > 180 * DAY)
     {
+        if (expires)
+            *expires = std::numeric_limits<time_t>::max();
+
         strftime(timeString, sizeof(timeString), "%F", &localTime);
     }
     else if (difference < HOUR)
     {
+        if (expires)
+            *expires = rawTime + (difference / MINUTE + 1) * MINUTE;
+
         snprintf(timeString, sizeof(timeString), "%u mins. ago", difference / MINUTE);
     }
     else if (difference < 7 * DAY)
     {
+        if (expires)
+        {
+            /* The day names shift at midnight */
+            struct tm midnight = currentLocalTime;
+            midnight.tm_sec = 0;
+            midnight.tm_min = 0;
+            midnight.tm_hour = 0;
+            ++midnight.tm_mday;
+            midnight.tm_isdst = -1;
+
+            *expires = std::min(mktime(&midnight), rawTime + 7 * DAY);
+
+            if (difference < DAY)
+                *expires = std::min(*expires, rawTime + DAY);
+        }
+
         if (localTime.tm_wday == currentLocalTime.tm_wday && difference < DAY)
         {
             strftime(timeString, sizeof(timeString), "Today %R", &localTime);
@@ -67,6 +98,9 @@ std::string relativeTime(time_t rawTime)
     }
     else
     {
+        if (expires)
+            *expires = rawTime + 180 * DAY + 1;
+
         strftime(timeString, sizeof(timeString), "%B %d", &localTime);
     }
 
@@ -93,5 +127,56 @@ std::string formatByteSize(long size)
     return val.str();
 }
 
-// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
+std::string takeString(char * string, const std::string & fallback)
+{
+    if (!string)
+        return fallback;
+
+    std::string ret(string);
+    g_free(string);
+
+    return ret;
+}
+
+GMimeStream * openMessageFile(const std::string & filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+
+    if (fd == -1)
+        return NULL;
 
+    /* Both streams take ownership of fd. Mapping fails for empty files, which
+     * are read normally instead. */
+    GMimeStream * stream = g_mime_stream_mmap_new(fd, PROT_READ, MAP_PRIVATE);
+
+    if (stream == NULL)
+        stream = g_mime_stream_fs_new(fd);
+
+    return stream;
+}
+
+GMimeStream * readMessageFile(const std::string & filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+
+    if (fd == -1)
+        return NULL;
+
+    GMimeStream * file = g_mime_stream_fs_new(fd);
+    GMimeStream * stream = g_mime_stream_mem_new();
+
+    gint64 length = g_mime_stream_write_to_stream(file, stream);
+    g_object_unref(file);
+
+    if (length == -1)
+    {
+        g_object_unref(stream);
+        return NULL;
+    }
+
+    g_mime_stream_reset(stream);
+
+    return stream;
+}
+
+// vim: fdm=syntax fo=croql et sw=4 sts=4 ts=8
@@ -30,10 +30,43 @@
 #include "ner_config.hh"
 #include "message_part.hh"
 
-std::string relativeTime(time_t rawTime);
+/**
+ * Describes rawTime relative to the current time.
+ *
+ * \param expires If set, receives the time at which the description
+ *        changes.
+ */
+std::string relativeTime(time_t rawTime, time_t * expires = NULL);
 
 std::string formatByteSize(long size);
 
+/**
+ * Copies a string allocated by glib, then frees it.
+ *
+ * \return fallback if string is NULL.
+ */
+std::string takeString(char * string, const std::string & fallback = std::string());
+
+/**
+ * Opens a message file for parsing, mapping it into memory if possible.
+ *
+ * A parser reading from the returned stream references the content of parts
+ * in the mapping rather than copying it, so the mapping lasts as long as any
+ * part parsed from it.
+ *
+ * \return NULL if the file cannot be opened.
+ */
+GMimeStream * openMessageFile(const std::string & filename);
+
+/**
+ * Reads a message file into memory for parsing, so that nothing parsed from
+ * it depends on the file afterwards. Use this for files which are rewritten
+ * or removed while they are shown, such as drafts.
+ *
+ * \return NULL if the file cannot be read.
+ */
+GMimeStream * readMessageFile(const std::string & filename);
+
 template <typename Type>
     struct addressOf : public std::unary_function<Type, Type *>
 {
@@ -138,6 +171,9 @@ class AutoUnref
 
 public:
     AutoUnref(T* g_object) : _g_object(g_object) {}
+    AutoUnref(AutoUnref && other) : _g_object(other._g_object) { other._g_object = NULL; }
+    AutoUnref(const AutoUnref &) = delete;
+    AutoUnref & operator=(const AutoUnref &) = delete;
     ~AutoUnref() { if (_g_object) g_object_unref(_g_object); }
 
     operator T*() { return _g_object; }
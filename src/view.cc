@@ -50,6 +50,11 @@ void View::unfocus()
 {
 }
 
+bool View::busy() const
+{
+    return false;
+}
+
 std::vector<std::string> View::status() const
 {
     return std::vector<std::string>();
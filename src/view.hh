@@ -76,6 +76,12 @@ class View : public InputHandler
          */
         virtual void unfocus();
 
+        /**
+         * Whether the view is waiting on background work, and should be
+         * updated again soon, even without any input.
+         */
+        virtual bool busy() const;
+
         virtual std::string name() const = 0;
         virtual std::vector<std::string> status() const;
 